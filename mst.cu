@@ -1,6 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#ifdef __linux__ // result cache (mmap, directory scan, file times) and wall clock
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#endif
 
 #include <cuda.h>
 
@@ -8,6 +17,15 @@
 
 #define THREADSPERBLOCK 64
 
+// result cache: one <hash>.mst file per input graph, FNV-1a over the parsed edge list
+#define HASH_OFFSET 14695981039346656037ULL
+#define HASH_PRIME 1099511628211ULL
+
+// vertex reordering criteria
+#define REORDER_NONE 0
+#define REORDER_BFS 1
+#define REORDER_DEGREE 2
+
 // graph
 struct edge{
 	int v;
@@ -61,6 +79,32 @@ struct strut_u_vertex{
     int weight;
 };
 
+// result cache entry, followed by the indices of the MST edges
+struct cache_header{
+    char magic[4]; // "MSTC"
+    int num_vertices;
+    int num_edges;
+    int num_mst_edges;
+    int solution_size;
+    unsigned long long hash;
+};
+
+#ifdef __linux__
+struct cache_entry{
+    char* path;
+    long long size;
+    struct timespec used; // modification time, nanosecond resolution
+};
+#endif
+
+// edge of the contracted graph handed to the serial finisher
+struct finisher_edge{
+    int v1;
+    int v2;
+    int weight;
+    int e; // original edge index
+};
+
 struct strut{
     int num_v; // num of bipartite vertices
     int num_u; // num of u vertices adjacent to strut edge
@@ -69,7 +113,24 @@ struct strut{
     struct strut_u_vertex* vertices_u; // u vertices - 0 value indicates not in strut, value > 0 indicates how many strut edges it is connected to
 };
 
-void get_graph(struct graph* og_graph, char* input);
+void get_graph(struct graph* og_graph, char* input, unsigned long long* hash);
+void gpu_mst(struct graph og_graph, bool* mst_edges, int* solution_size, int serial_threshold);
+void serial_finish(int num_bipartite_edges, struct b_edge* d_bg_edges, int num_vertices, int og_num_edges, bool* mst_edges, int* solution_size);
+int compare_finisher_edges(const void* a, const void* b);
+int find_root(int* parent, int v);
+int calibrate_threshold(struct graph og_graph, bool* mst_edges, int* solution_size);
+bool threshold_file(char* path, char* cache_dir);
+int read_threshold(char* path);
+void write_threshold(char* path, int threshold);
+double wall_time();
+unsigned long long hash_int(unsigned long long hash, int value);
+bool cache_lookup(char* dir, unsigned long long hash, struct graph* og_graph, bool* mst_edges, int* solution_size);
+void cache_store(char* dir, long long max_bytes, unsigned long long hash, struct graph* og_graph, bool* mst_edges, int solution_size);
+void cache_evict(char* dir, long long max_bytes);
+int compare_cache_entries(const void* a, const void* b);
+int* get_vertex_order(struct graph* og_graph, int criterion);
+void reorder_graph(struct graph* og_graph, int* new_id, int* edge_order);
+void measure_locality(struct graph* og_graph, double* distance, double* near);
 __global__ void get_bipartite_graph(int num_edges, int num_vertices, struct edge* graphEdges, struct b_vertex_a* vetices_a, struct b_vertex_b* vetices_b, struct b_edge* bg_graphEdges) ;
 
 
@@ -109,16 +170,150 @@ __global__ void init_smallest_edges_weights(int num_edges, int *smallest_weights
 
 // driver
 int main(int argc, char** argv){
-	if(argc != 3){
+	if(argc < 3){
 		printf("mst: incorrect formatting\n");
-		printf("Valid input: mst.out <Input file name> <Output file name>\n");
+		printf("Valid input: mst.out <Input file name> <Output file name> [--reorder bfs|degree] [--cache <dir>] [--cache-max <MB>] [--serial-threshold <edges or fragments>|auto | --calibrate]\n");
 		return 0;
 	}
 
+	int reorder = REORDER_NONE;
+	char* cache_dir = NULL;
+	long long cache_max_bytes = 256LL << 20;
+	int serial_threshold = 0;
+	bool threshold_auto = false;
+	bool calibrate = false;
+	for(int i = 3; i < argc; i++){
+		if(strcmp(argv[i], "--cache") == 0 && i+1 < argc){
+#ifdef __linux__
+			cache_dir = argv[++i];
+#else
+			printf("mst: --cache is only supported on Linux, ignoring %s\n", argv[++i]);
+#endif
+		}
+		else if(strcmp(argv[i], "--cache-max") == 0 && i+1 < argc)
+			cache_max_bytes = atoll(argv[++i]) << 20;
+		else if(strcmp(argv[i], "--serial-threshold") == 0 && i+1 < argc){
+			i++;
+			if(strcmp(argv[i], "auto") == 0)
+				threshold_auto = true;
+			else
+				serial_threshold = atoi(argv[i]);
+		}
+		else if(strcmp(argv[i], "--calibrate") == 0)
+			calibrate = true;
+		else if(strcmp(argv[i], "--reorder") == 0 && i+1 < argc){
+			i++;
+			if(strcmp(argv[i], "bfs") == 0)
+				reorder = REORDER_BFS;
+			else if(strcmp(argv[i], "degree") == 0)
+				reorder = REORDER_DEGREE;
+			else{
+				printf("mst: unknown reorder criterion %s\n", argv[i]);
+				return 0;
+			}
+		}
+	}
+
+	// --serial-threshold auto uses the value saved in the cache directory by the last --calibrate run
+	char threshold_path[4096];
+	bool has_threshold_path = threshold_file(threshold_path, cache_dir);
+	if(threshold_auto && !calibrate){
+		if(!has_threshold_path)
+			printf("mst: --serial-threshold auto needs --cache, using 0\n");
+		else if((serial_threshold = read_threshold(threshold_path)) >= 0)
+			printf("Serial finisher threshold read from %s: %d\n", threshold_path, serial_threshold);
+		else{
+			printf("mst: no calibrated threshold in %s, using 0\n", threshold_path);
+			serial_threshold = 0;
+		}
+	}
+
 	//***** ACQUIRE INPUT GRAPH *****//
 	struct graph og_graph; // input
-	get_graph(&og_graph, argv[1]);
+	unsigned long long graph_hash;
+	get_graph(&og_graph, argv[1], &graph_hash);
+
+	bool* mst_edges = (bool*) malloc(og_graph.num_edges * sizeof(bool));
+	int* solution_size = (int*) malloc(sizeof(int));
+	*solution_size = 0;
+
+	//***** RESULT CACHE *****//
+	bool cache_hit = false;
+	if(cache_dir != NULL && !calibrate){
+		cache_hit = cache_lookup(cache_dir, graph_hash, &og_graph, mst_edges, solution_size);
+		printf("Cache %016llx: %s\n", graph_hash, cache_hit ? "hit" : "miss");
+	}
+
+	if(!cache_hit){
+		//***** RELABEL VERTICES FOR LOCALITY *****//
+		// og_graph is relabelled in place; input_edges keeps the edges as read for the output
+		struct edge* input_edges = NULL;
+		int* edge_order = NULL; // edge i of og_graph is edge edge_order[i] of the input
+		if(reorder != REORDER_NONE){
+			double distance_before, near_before, distance_after, near_after;
+			input_edges = (struct edge*) malloc(og_graph.num_edges * sizeof(struct edge));
+			memcpy(input_edges, og_graph.edges, og_graph.num_edges * sizeof(struct edge));
+			edge_order = (int*) malloc(og_graph.num_edges * sizeof(int));
+
+			measure_locality(&og_graph, &distance_before, &near_before);
+			int* new_id = get_vertex_order(&og_graph, reorder);
+			reorder_graph(&og_graph, new_id, edge_order);
+			free(new_id);
+			measure_locality(&og_graph, &distance_after, &near_after);
+
+			printf("Reordering: mean id distance between consecutive vertex accesses %.1f -> %.1f\n", distance_before, distance_after);
+			printf("Reordering: accesses in the same cache line as the previous one %.1f%% -> %.1f%%\n", 100*near_before, 100*near_after);
+		}
+
+		// benchmark mode: the solution is the one of the fastest calibration run
+		if(calibrate)
+			serial_threshold = calibrate_threshold(og_graph, mst_edges, solution_size);
+		else
+			gpu_mst(og_graph, mst_edges, solution_size, serial_threshold);
+
+		// map the solution back to the input edges and vertex ids
+		if(reorder != REORDER_NONE){
+			bool* input_mst_edges = (bool*) malloc(og_graph.num_edges * sizeof(bool));
+			for(int i = 0; i < og_graph.num_edges; i++)
+				input_mst_edges[edge_order[i]] = mst_edges[i];
+			free(mst_edges);
+			free(og_graph.edges);
+			free(edge_order);
+			mst_edges = input_mst_edges;
+			og_graph.edges = input_edges;
+		}
+
+		if(cache_dir != NULL)
+			cache_store(cache_dir, cache_max_bytes, graph_hash, &og_graph, mst_edges, *solution_size);
+		// cache_store has created the directory
+		if(calibrate && has_threshold_path)
+			write_threshold(threshold_path, serial_threshold);
+	}
+
+    FILE *file;
+    file = fopen(argv[2],"w+");
+    fprintf(file,"Input Graph\nVertices: %d Edges: %d\n", og_graph.num_vertices, og_graph.num_edges);
+    fprintf(file,"Trees in forest: %d\n", og_graph.num_vertices - *solution_size);
+    if(cache_hit)
+        fprintf(file,"Result read from cache %s\n", cache_dir);
+    else if(serial_threshold > 0)
+        fprintf(file,"Serial finisher threshold: %d edges or fragments\n", serial_threshold);
+    fprintf(file, "MST Edges:\n");
+    for(int i = 0; i < og_graph.num_edges; i++){
+        if(mst_edges[i] == true){
+            fprintf(file, "index: %d - v: %d  u: %d  weight: %d\n", i, og_graph.edges[i].v, og_graph.edges[i].u, og_graph.edges[i].weight);
+        }
+    }
+    fclose(file);
+
+    free(og_graph.edges);
+    free(mst_edges);
+    free(solution_size);
+}
 
+// runs the strut iterations on the GPU, flagging in mst_edges the edges of og_graph in the spanning forest;
+// once at most serial_threshold edges or fragments are left the contracted graph is finished on the host
+void gpu_mst(struct graph og_graph, bool* mst_edges, int* solution_size, int serial_threshold){
 	//debugging
 	// printf("Graph:\n");
 	// printf("vertices:%d edges:%d\n",og_graph.num_vertices, og_graph.num_edges);
@@ -173,15 +368,12 @@ int main(int argc, char** argv){
 	
     //***** GET SOLUTION *****//
     bool* d_mst_edges = NULL;
-    bool* mst_edges = NULL;
-    mst_edges = (bool*) malloc(og_graph.num_edges * sizeof(bool));
 
     // don't malloc again for this variable
     cudaMalloc((void**) &(d_mst_edges), og_graph.num_edges* sizeof(bool));
     
     mst_edges_init<<<(og_graph.num_edges + THREADSPERBLOCK-1)/THREADSPERBLOCK, THREADSPERBLOCK>>>(og_graph.num_edges, d_mst_edges);
 
-    int * solution_size = (int*) malloc (sizeof(int));
     *solution_size = 0;
     int* d_solutionSize = NULL;
     cudaMalloc((void**) &(d_solutionSize),sizeof(int));
@@ -190,7 +382,16 @@ int main(int argc, char** argv){
     int* max_super_vertex = (int*) malloc (sizeof(int));
     *max_super_vertex = bg_graph.num_vertex_a;
     
-    while(*solution_size <  (og_graph.num_vertices - 1)){
+    // a disconnected input yields a spanning forest: stop once no bipartite edges join two fragments
+    while(*solution_size <  (og_graph.num_vertices - 1) && bg_graph.num_bipartite_edges > 0){
+        // a small contracted graph is dominated by launch, allocation and copy overhead: finish with kruskal
+        // (num_vertex_a is the number of fragments: zero-diff count after each contraction)
+        if(bg_graph.num_bipartite_edges / 2 <= serial_threshold || bg_graph.num_vertex_a <= serial_threshold){
+            cudaMemcpy(mst_edges, d_mst_edges, og_graph.num_edges * sizeof(bool), cudaMemcpyDeviceToHost);
+            serial_finish(bg_graph.num_bipartite_edges, bg_graph.edges, og_graph.num_vertices, og_graph.num_edges, mst_edges, solution_size);
+            break;
+        }
+
         // cudaMalloc((void**) &(smallest_weights), bg_graph.num_vertex_a * sizeof(int));
         // cudaMalloc((void**) &(smallest_edges), bg_graph.num_vertex_a * sizeof(int));
         //get_smallest_edges<<<(bg_graph.num_bipartite_edges + THREADSPERBLOCK-1)/THREADSPERBLOCK, THREADSPERBLOCK>>>(bg_graph.num_bipartite_edges, bg_graph.num_vertex_a, bg_graph.edges, smallest_weights, smallest_edges);
@@ -360,6 +561,7 @@ int main(int argc, char** argv){
 
             int* d_max_super_vertex = NULL;
             cudaMalloc((void**) &(d_max_super_vertex),sizeof(int));
+            cudaMemset(d_max_super_vertex, 0, sizeof(int)); // get_new_bg_edges only raises it with atomicMax
             get_new_bg_edges<<<(bg_graph.num_vertex_b + THREADSPERBLOCK-1)/THREADSPERBLOCK, THREADSPERBLOCK>>>(bg_graph.num_vertex_b , new_vertex_b, prefixSum, d_vertices_u, d_super_vertices, new_bg_graph.edges, d_max_super_vertex);
             cudaMemcpy(max_super_vertex, d_max_super_vertex, sizeof(int), cudaMemcpyDeviceToHost);
 
@@ -412,36 +614,21 @@ int main(int argc, char** argv){
 
     //printf("done with loop\n");
     /*end of while loop*/
-    FILE *file;
-    file = fopen(argv[argc-1],"w+");
-    fprintf(file,"Input Graph\nVertices: %d Edges: %d\n", og_graph.num_vertices, og_graph.num_edges);
-    fprintf(file, "MST Edges:\n");
-    for(int i = 0; i < og_graph.num_edges; i++){
-        if(mst_edges[i] == true){
-            fprintf(file, "index: %d - v: %d  u: %d  weight: %d\n", i, og_graph.edges[i].v, og_graph.edges[i].u, og_graph.edges[i].weight);
-        }
-    }
-    fclose(file);
 
     // malloc frees
     free(max_super_vertex);
-    free(og_graph.edges);
-    free(mst_edges);
-    free(solution_size);
-    free(max_super_vertex);
-    
 
     // cuda malloc frees
     cudaFree(d_solutionSize);
     cudaFree(d_mst_edges);
-    cudaFree(mst_edges);
 	cudaFree(d_og_edges);
 	cudaFree(bg_graph.vertices_a);
 	cudaFree(bg_graph.vertices_b);
 	cudaFree(bg_graph.edges);
 }
 
-void get_graph(struct graph* og_graph, char* input){
+// reads the graph and hashes the edge list as parsed (endpoints in increasing order) for the result cache
+void get_graph(struct graph* og_graph, char* input, unsigned long long* hash){
 	FILE *file;
 	char buff[255];
 	int num_vertices;
@@ -462,6 +649,7 @@ void get_graph(struct graph* og_graph, char* input){
     	(*og_graph).num_edges = num_edges;
     	(*og_graph).num_vertices = num_vertices;
     	(*og_graph).edges = (struct edge*) malloc(sizeof(struct edge) * num_edges);
+    	*hash = hash_int(hash_int(HASH_OFFSET, num_vertices), num_edges);
 
     	for(int i = 0; i < num_edges; i++){
 			fscanf(file, "%s", buff);
@@ -472,12 +660,427 @@ void get_graph(struct graph* og_graph, char* input){
 
 			fscanf(file, "%s", buff);
 			(*og_graph).edges[i].weight = atoi(buff);
+
+			int v = (*og_graph).edges[i].v;
+			int u = (*og_graph).edges[i].u;
+			*hash = hash_int(hash_int(hash_int(*hash, v < u ? v : u), v < u ? u : v), (*og_graph).edges[i].weight);
     	}
     }
     fclose(file);
 }
 
 
+// new id (1-based) for every vertex, in breadth-first order or by decreasing degree,
+// so that vertices touched by neighbouring bipartite edges sit close in memory
+int* get_vertex_order(struct graph* og_graph, int criterion){
+    int n = (*og_graph).num_vertices;
+    int m = (*og_graph).num_edges;
+    int* new_id = (int*) malloc((n + 1) * sizeof(int));
+    int* degree = (int*) calloc(n + 1, sizeof(int));
+
+    for(int i = 0; i < m; i++){
+        degree[(*og_graph).edges[i].v]++;
+        degree[(*og_graph).edges[i].u]++;
+    }
+
+    if(criterion == REORDER_DEGREE){
+        // counting sort on degree, highest first
+        int* count = (int*) calloc(n + 2, sizeof(int));
+        for(int v = 1; v <= n; v++)
+            count[n - (degree[v] < n ? degree[v] : n)]++;
+        for(int i = 1; i <= n; i++)
+            count[i] += count[i-1];
+        for(int v = n; v >= 1; v--)
+            new_id[v] = count[n - (degree[v] < n ? degree[v] : n)]--;
+        free(count);
+        free(degree);
+        return new_id;
+    }
+
+    // adjacency lists
+    int* start = (int*) malloc((n + 2) * sizeof(int));
+    int* adj = (int*) malloc((2*m + 1) * sizeof(int));
+    start[0] = start[1] = 0;
+    for(int v = 1; v <= n; v++)
+        start[v+1] = start[v] + degree[v];
+    for(int i = 0; i < m; i++){
+        int v = (*og_graph).edges[i].v;
+        int u = (*og_graph).edges[i].u;
+        adj[start[v] + --degree[v]] = u;
+        adj[start[u] + --degree[u]] = v;
+    }
+
+    // breadth first search from every vertex not reached yet
+    int* queue = (int*) malloc((n + 1) * sizeof(int));
+    int tail = 0;
+    for(int v = 1; v <= n; v++)
+        new_id[v] = 0;
+    for(int s = 1; s <= n; s++){
+        if(new_id[s] != 0)
+            continue;
+        queue[tail++] = s;
+        new_id[s] = tail;
+        for(int head = tail - 1; head < tail; head++){
+            int v = queue[head];
+            for(int j = start[v]; j < start[v+1]; j++){
+                if(new_id[adj[j]] == 0){
+                    queue[tail++] = adj[j];
+                    new_id[adj[j]] = tail;
+                }
+            }
+        }
+    }
+
+    free(queue);
+    free(adj);
+    free(start);
+    free(degree);
+    return new_id;
+}
+
+// relabels the vertices with new_id and sorts the edges by their smaller endpoint (counting sort)
+void reorder_graph(struct graph* og_graph, int* new_id, int* edge_order){
+    int n = (*og_graph).num_vertices;
+    int m = (*og_graph).num_edges;
+    struct edge* edges = (struct edge*) malloc(m * sizeof(struct edge));
+    int* count = (int*) calloc(n + 2, sizeof(int));
+
+    for(int i = 0; i < m; i++){
+        int v = new_id[(*og_graph).edges[i].v];
+        int u = new_id[(*og_graph).edges[i].u];
+        count[v < u ? v : u]++;
+    }
+    for(int i = 1; i <= n; i++)
+        count[i] += count[i-1];
+
+    for(int i = m - 1; i >= 0; i--){
+        int v = new_id[(*og_graph).edges[i].v];
+        int u = new_id[(*og_graph).edges[i].u];
+        int pos = --count[v < u ? v : u];
+        edges[pos].v = v < u ? v : u;
+        edges[pos].u = v < u ? u : v;
+        edges[pos].weight = (*og_graph).edges[i].weight;
+        edge_order[pos] = i;
+    }
+
+    free(count);
+    free((*og_graph).edges);
+    (*og_graph).edges = edges;
+}
+
+// mean id distance between the vertices read one after the other by the bipartite edges,
+// and the fraction of those reads that land in the same 64 byte line of super_vertices
+void measure_locality(struct graph* og_graph, double* distance, double* near){
+    int m = (*og_graph).num_edges;
+    double sum = 0;
+    long same_line = 0;
+    int prev = -1;
+
+    for(int i = 0; i < 2*m; i++){
+        int x = (i%2 == 0) ? (*og_graph).edges[i/2].v : (*og_graph).edges[i/2].u;
+        if(prev != -1){
+            sum += (x > prev) ? x - prev : prev - x;
+            if(((x-1) * sizeof(int)) / 64 == ((prev-1) * sizeof(int)) / 64)
+                same_line++;
+        }
+        prev = x;
+    }
+    *distance = (m > 0) ? sum / (2*m - 1) : 0;
+    *near = (m > 0) ? (double) same_line / (2*m - 1) : 0;
+}
+
+// FNV-1a step over the bytes of value
+unsigned long long hash_int(unsigned long long hash, int value){
+    unsigned char* bytes = (unsigned char*) &value;
+    for(int i = 0; i < (int) sizeof(int); i++){
+        hash ^= bytes[i];
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
+#ifdef __linux__
+// maps the cache entry for this hash, if any, and fills mst_edges; a hit refreshes the file time used by the LRU
+bool cache_lookup(char* dir, unsigned long long hash, struct graph* og_graph, bool* mst_edges, int* solution_size){
+    char path[4096];
+    struct stat st;
+    if(strlen(dir) > sizeof(path) - 32)
+        return false;
+    sprintf(path, "%s/%016llx.mst", dir, hash);
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct cache_header)){
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    // guard against hash collisions and truncated files
+    struct cache_header* header = (struct cache_header*) map;
+    int* indices = (int*) ((char*) map + sizeof(struct cache_header));
+    bool hit = memcmp(header->magic, "MSTC", 4) == 0 && header->hash == hash
+        && header->num_vertices == (*og_graph).num_vertices && header->num_edges == (*og_graph).num_edges
+        && header->num_mst_edges >= 0 && header->num_mst_edges <= (*og_graph).num_edges
+        && st.st_size == (off_t) (sizeof(struct cache_header) + header->num_mst_edges * sizeof(int));
+    for(int i = 0; hit && i < header->num_mst_edges; i++)
+        if(indices[i] < 0 || indices[i] >= (*og_graph).num_edges)
+            hit = false;
+
+    if(hit){
+        for(int i = 0; i < (*og_graph).num_edges; i++)
+            mst_edges[i] = false;
+        for(int i = 0; i < header->num_mst_edges; i++)
+            mst_edges[indices[i]] = true;
+        *solution_size = header->solution_size;
+    }
+    munmap(map, st.st_size);
+    if(hit)
+        utimes(path, NULL);
+    return hit;
+}
+
+// writes the entry under a temporary name and renames it into place, then trims the cache to max_bytes
+void cache_store(char* dir, long long max_bytes, unsigned long long hash, struct graph* og_graph, bool* mst_edges, int solution_size){
+    char path[4096];
+    char tmp_path[4096];
+    if(strlen(dir) > sizeof(path) - 32)
+        return;
+    mkdir(dir, 0755);
+    sprintf(path, "%s/%016llx.mst", dir, hash);
+    sprintf(tmp_path, "%s/.%016llx.%d", dir, hash, (int) getpid());
+
+    struct cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MSTC", 4);
+    header.num_vertices = (*og_graph).num_vertices;
+    header.num_edges = (*og_graph).num_edges;
+    header.solution_size = solution_size;
+    header.hash = hash;
+    int* indices = (int*) malloc(((*og_graph).num_edges + 1) * sizeof(int));
+    for(int i = 0; i < (*og_graph).num_edges; i++)
+        if(mst_edges[i] == true)
+            indices[header.num_mst_edges++] = i;
+
+    FILE* file = fopen(tmp_path, "wb");
+    if(file == NULL){
+        perror(tmp_path);
+        free(indices);
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(indices, sizeof(int), header.num_mst_edges, file) == (size_t) header.num_mst_edges;
+    ok = fclose(file) == 0 && ok;
+    free(indices);
+    if(!ok || rename(tmp_path, path) != 0){
+        perror(path);
+        unlink(tmp_path);
+        return;
+    }
+    cache_evict(dir, max_bytes);
+}
+
+// removes least recently used entries until the .mst files fit in max_bytes: one directory scan, sorted by modification time
+void cache_evict(char* dir, long long max_bytes){
+    char path[4096];
+    DIR* d = opendir(dir);
+    if(d == NULL)
+        return;
+    long long total = 0;
+    int num_entries = 0;
+    int capacity = 64;
+    struct cache_entry* entries = (struct cache_entry*) malloc(capacity * sizeof(struct cache_entry));
+    struct dirent* entry;
+    while((entry = readdir(d)) != NULL){
+        size_t len = strlen(entry->d_name);
+        if(len < 4 || strcmp(entry->d_name + len - 4, ".mst") != 0 || entry->d_name[0] == '.')
+            continue;
+        if(strlen(dir) + len + 2 > sizeof(path))
+            continue;
+        strcpy(path, dir);
+        strcat(path, "/");
+        strcat(path, entry->d_name);
+        struct stat st;
+        if(stat(path, &st) != 0)
+            continue;
+        if(num_entries == capacity){
+            capacity *= 2;
+            entries = (struct cache_entry*) realloc(entries, capacity * sizeof(struct cache_entry));
+        }
+        entries[num_entries].path = strdup(path);
+        entries[num_entries].size = st.st_size;
+        entries[num_entries].used = st.st_mtim;
+        total += st.st_size;
+        num_entries++;
+    }
+    closedir(d);
+
+    qsort(entries, num_entries, sizeof(struct cache_entry), compare_cache_entries);
+    for(int i = 0; i < num_entries && total > max_bytes; i++)
+        if(unlink(entries[i].path) == 0)
+            total -= entries[i].size;
+
+    for(int i = 0; i < num_entries; i++)
+        free(entries[i].path);
+    free(entries);
+}
+
+int compare_cache_entries(const void* a, const void* b){
+    const struct cache_entry* x = (const struct cache_entry*) a;
+    const struct cache_entry* y = (const struct cache_entry*) b;
+    if(x->used.tv_sec != y->used.tv_sec)
+        return (x->used.tv_sec > y->used.tv_sec) - (x->used.tv_sec < y->used.tv_sec);
+    return (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec);
+}
+#else
+// the cache needs mmap, directory scans and nanosecond file times; main rejects --cache elsewhere
+bool cache_lookup(char* dir, unsigned long long hash, struct graph* og_graph, bool* mst_edges, int* solution_size){
+    return false;
+}
+
+void cache_store(char* dir, long long max_bytes, unsigned long long hash, struct graph* og_graph, bool* mst_edges, int solution_size){
+}
+
+void cache_evict(char* dir, long long max_bytes){
+}
+
+int compare_cache_entries(const void* a, const void* b){
+    return 0;
+}
+#endif
+
+// kruskal over the contracted bipartite graph: edges 2k and 2k+1 are the two halves of one original edge
+// between super vertices, u holds the original edge index; super vertex labels are original ids 1..num_vertices
+void serial_finish(int num_bipartite_edges, struct b_edge* d_bg_edges, int num_vertices, int og_num_edges, bool* mst_edges, int* solution_size){
+    int num_edges = num_bipartite_edges / 2;
+    struct b_edge* bg_edges = (struct b_edge*) malloc(num_bipartite_edges * sizeof(struct b_edge));
+    cudaMemcpy(bg_edges, d_bg_edges, num_bipartite_edges * sizeof(struct b_edge), cudaMemcpyDeviceToHost);
+
+    struct finisher_edge* edges = (struct finisher_edge*) malloc((num_edges + 1) * sizeof(struct finisher_edge));
+    for(int i = 0; i < num_edges; i++){
+        edges[i].v1 = bg_edges[2*i].v;
+        edges[i].v2 = bg_edges[bg_edges[2*i].cv].v;
+        edges[i].weight = bg_edges[2*i].weight;
+        edges[i].e = bg_edges[2*i].u;
+    }
+    qsort(edges, num_edges, sizeof(struct finisher_edge), compare_finisher_edges);
+
+    int* parent = (int*) malloc((num_vertices + 1) * sizeof(int));
+    for(int v = 0; v <= num_vertices; v++)
+        parent[v] = v;
+    for(int i = 0; i < num_edges; i++){
+        int x = find_root(parent, edges[i].v1);
+        int y = find_root(parent, edges[i].v2);
+        if(x != y){
+            parent[x > y ? x : y] = x < y ? x : y;
+            mst_edges[edges[i].e] = true;
+        }
+    }
+
+    *solution_size = 0;
+    for(int i = 0; i < og_num_edges; i++)
+        if(mst_edges[i] == true)
+            (*solution_size)++;
+
+    free(parent);
+    free(edges);
+    free(bg_edges);
+}
+
+int compare_finisher_edges(const void* a, const void* b){
+    const struct finisher_edge* x = (const struct finisher_edge*) a;
+    const struct finisher_edge* y = (const struct finisher_edge*) b;
+    if(x->weight != y->weight)
+        return x->weight < y->weight ? -1 : 1;
+    return (x->e > y->e) - (x->e < y->e);
+}
+
+int find_root(int* parent, int v){
+    while(parent[v] != v){
+        parent[v] = parent[parent[v]]; // path halving
+        v = parent[v];
+    }
+    return v;
+}
+
+// times gpu_mst with thresholds 0, 64, 256, ... below the edge and vertex counts (from there the finisher would start
+// at the first iteration), best of 3 runs each, and returns the fastest;
+// mst_edges and solution_size receive the solution of the fastest run
+int calibrate_threshold(struct graph og_graph, bool* mst_edges, int* solution_size){
+    bool* run_edges = (bool*) malloc((og_graph.num_edges + 1) * sizeof(bool));
+    int run_size;
+    int best = 0;
+    double best_time = -1;
+
+    printf("Calibrating serial finisher threshold\n");
+    for(int threshold = 0; threshold == 0 || (threshold < og_graph.num_edges && threshold < og_graph.num_vertices); threshold = (threshold == 0) ? 64 : 4*threshold){
+        double threshold_time = -1;
+        for(int run = 0; run < 3; run++){
+            double start = wall_time();
+            gpu_mst(og_graph, run_edges, &run_size, threshold);
+            cudaDeviceSynchronize();
+            double elapsed = wall_time() - start;
+            if(threshold_time < 0 || elapsed < threshold_time)
+                threshold_time = elapsed;
+            if(best_time < 0 || elapsed < best_time){
+                best = threshold;
+                best_time = elapsed;
+                memcpy(mst_edges, run_edges, og_graph.num_edges * sizeof(bool));
+                *solution_size = run_size;
+            }
+        }
+        printf("threshold %d: %f s\n", threshold, threshold_time);
+    }
+    printf("chosen threshold: %d\n", best);
+    free(run_edges);
+    return best;
+}
+
+// the calibrated threshold lives in the cache directory; false without --cache
+bool threshold_file(char* path, char* cache_dir){
+    if(cache_dir == NULL || strlen(cache_dir) >= 4000)
+        return false;
+    sprintf(path, "%s/serial_threshold", cache_dir);
+    return true;
+}
+
+// returns -1 when the file is missing or holds no valid threshold
+int read_threshold(char* path){
+    FILE* file = fopen(path, "r");
+    if(file == NULL)
+        return -1;
+    int threshold;
+    if(fscanf(file, "%d", &threshold) != 1 || threshold < 0)
+        threshold = -1;
+    fclose(file);
+    return threshold;
+}
+
+void write_threshold(char* path, int threshold){
+    FILE* file = fopen(path, "w");
+    if(file == NULL){
+        perror(path);
+        return;
+    }
+    fprintf(file, "%d\n", threshold);
+    fclose(file);
+    printf("Serial finisher threshold saved to %s\n", path);
+}
+
+double wall_time(){
+#ifdef __linux__
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1e6;
+#else
+    return (double) clock() / CLOCKS_PER_SEC; // wall clock with the Windows C runtime
+#endif
+}
+
 __global__ void get_bipartite_graph(int num_edges, int num_vertices, struct edge* graphEdges, struct b_vertex_a* vertices_a, struct b_vertex_b* vertices_b, struct b_edge* bg_graphEdges) {
     int edge = threadIdx.x + blockIdx.x * blockDim.x;
 
@@ -573,6 +1176,12 @@ __global__ void get_strut_edges(int bg_num_vertices, int* smallest_edges, struct
     int bg_vertex = threadIdx.x + blockIdx.x * blockDim.x;
     
     if(bg_vertex < bg_num_vertices){
+        if(smallest_edges[bg_vertex] == -1){ // vertex with no edges left (disconnected graph)
+            strut_edges[bg_vertex].v = bg_vertex + 1;
+            strut_edges[bg_vertex].u = -1;
+            strut_edges[bg_vertex].cv = -1;
+            return;
+        }
         strut_edges[bg_vertex].v = bg_vertex + 1; // vertex
         strut_edges[bg_vertex].u = bg_graphEdges[smallest_edges[bg_vertex]].u; // edge index (u vertex)
         strut_edges[bg_vertex].cv = bg_graphEdges[bg_graphEdges[smallest_edges[bg_vertex]].cv].v; // save vertex that is connected to same edge index (u vertex);
@@ -591,7 +1200,7 @@ __global__ void strut_u_init(int bg_num_vertex_b, struct strut_u_vertex* vertice
 __global__ void get_strut_u_degree(int num_strut_vertices, strut_edge* strut_edges, struct strut_u_vertex* vertices_u){
     int strut_edge = threadIdx.x + blockIdx.x * blockDim.x;
 
-    if(strut_edge < num_strut_vertices){
+    if(strut_edge < num_strut_vertices && strut_edges[strut_edge].u != -1){
         atomicAdd(&(vertices_u[strut_edges[strut_edge].u]).degree, 1);
     }
 }
@@ -6,6 +6,33 @@
 	Compilation:	gcc -o mst_seq.exe mst_seq.c
 	Execution:	./mst_seq.exe input.txt output.txt
 	
+	If the input graph is disconnected the program returns a minimum spanning
+	forest: the loop stops when no bipartite edges remain between fragments.
+	
+	Distributed execution:	./mst_seq.exe input.txt output.txt S --processos 4
+	splits the edge list among 4 worker processes; each one computes the forest
+	of its shard and the forests are merged pairwise (tree reduction) through
+	the selected transport (--transporte unix) until one MST remains.
+	
+	--pin pins each worker process to one core (cores taken from the NUMA nodes
+	in turn) and --numa local|intercalada places the memory: local keeps each
+	worker on its node and allocates its shard and bipartite arrays there on
+	first touch, intercalada interleaves all pages over the nodes. The two
+	options are independent (also with a single process). With either option
+	each process (the workers start together) streams a buffer of its own larger
+	than the last-level cache and the read bandwidth is reported per node.
+	
+	--limiar N hands the contracted graph to a sequential Kruskal once at most N
+	edges or at most N fragments remain. --calibra is the benchmark mode: it
+	times a few thresholds below the number of edges and vertices of the input
+	(with the same --processos) and keeps the solution of the fastest run; with
+	--cache the chosen threshold is saved as limiar.P in the cache directory
+	(P = processes) and --limiar auto reads it back.
+	
+	--reordena bfs|grau relabels the vertices (breadth-first order or decreasing
+	degree) and sorts the edges by the new labels before building the bipartite
+	graph; the solution is mapped back to the original edges and vertex ids.
+	
 	Input data: this program reads a ghaph information like this
 	8
 	16
@@ -30,10 +57,27 @@
 			the subsequent lines are the edges in the format v1 v2 weight
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE // sched_setaffinity, sched_getcpu
+#endif
 #include <stdio.h> // printf
 #include<stdbool.h> // true, false
 #include <stdlib.h> //malloc
 #include <time.h> //clock
+#include <string.h> //strcmp
+#include <unistd.h> //fork, read, write
+#include <sys/types.h>
+#include <sys/socket.h> //socketpair
+#include <sys/wait.h> //waitpid
+#include <sys/stat.h> //mkdir, stat
+#include <sys/time.h> //utimes
+#include <sys/mman.h> //mmap
+#include <fcntl.h> //open
+#include <dirent.h> //opendir
+#ifdef __linux__
+#include <sched.h> //sched_setaffinity
+#include <sys/syscall.h> //set_mempolicy
+#endif
 
 // Grafo Original
 typedef struct { 
@@ -95,8 +139,96 @@ typedef struct {
 } uc;
 
 
+// Aresta do grafo contraído para o Kruskal final
+typedef struct { 
+	float custo;
+	int ind_u;
+} aresta_kruskal;
+
+
+// Solução
+typedef struct { 
+	int *arestas; // índices das arestas do grafo original que compõem a solução
+	int tam, it;
+	double custo;
+} solucao;
+
+
+// Transporte entre processos (execução distribuída)
+typedef struct { 
+	int fd[2]; // uma extremidade para cada lado do canal
+} canal;
+
+typedef struct { 
+	const char *nome;
+	int (*abre)(canal *);
+	int (*envia)(canal *, int, const void *, size_t);
+	int (*recebe)(canal *, int, void *, size_t);
+	void (*fecha)(canal *, int);
+} transporte;
+
+typedef struct { 
+	long bytes; // volume recebido na rodada
+	double tempo_espera; // até a chegada do tamanho: o parceiro ainda calculava sua floresta
+	double tempo_com, tempo_uniao; // transferência da floresta e união
+} estat_rodada;
+
+
+// Posicionamento NUMA
+#define NUMA_PADRAO 0
+#define NUMA_LOCAL 1
+#define NUMA_INTERCALADA 2
+
+// Políticas de set_mempolicy (linux/mempolicy.h)
+#define POLITICA_PREFERIDA 1
+#define POLITICA_INTERCALADA 3
+
+typedef struct { 
+	int n_cpus, n_nos;
+	int *cpus; // CPUs permitidas, alternando entre os nós
+	int *no; // nó de cada CPU de cpus
+	long cache_llc; // bytes do último nível de cache (0 se desconhecido)
+} topologia;
+
+typedef struct { 
+	int no, processos;
+	long bytes; // lidos da memória do processo, fora da cache
+	double inicio, fim; // Relogio é o mesmo para todos os processos
+} estat_no;
+
+
+// Cache de resultados: um arquivo <hash>.mst por grafo, com este cabeçalho 
+// seguido dos índices das arestas da solução
+#define HASH_INICIAL 14695981039346656037ULL // FNV-1a 64 bits
+#define HASH_PRIMO 1099511628211ULL
+
+typedef struct { 
+	char magica[4]; // "MSTS"
+	int n, m, tam, it;
+	unsigned long long hash;
+	double custo;
+} cabecalho_cache;
+
+typedef struct { 
+	char *caminho;
+	long long tam;
+	struct timespec uso; // data de modificação, em nanossegundos
+} entrada_cache;
+
+
+// Vetor usado para medir a banda de memória: 2x o último nível de cache, nestes limites
+#define BANDA_MIN_BYTES (64L << 20)
+#define BANDA_MAX_BYTES (512L << 20)
+
+
+// Critérios de reordenação dos vértices
+#define REORDENA_NENHUM 0
+#define REORDENA_BFS 1
+#define REORDENA_GRAU 2
+
+
 // Funções e Procedimentos
-grafo_original LeGrafo(char *);
+grafo_original LeGrafo(char *, unsigned long long *);
 void MostraGrafoOriginal(grafo_original);
 aresta_go *OrdenaArestasGO_v_u(aresta_go*, int, int, bool);
 grafo_bipartido CriaGrafoBipartido(grafo_original GO);
@@ -109,21 +241,69 @@ grafo_bipartido CompactarGrafo(grafo_bipartido, grafo_original, uc *, int);
 void CD_Inic(int, uc *);
 int CD_chefe(int, uc *);
 void CD_Uniao(int, int, uc *);
+solucao EncontraSolucao(grafo_original, bool, int);
+void FinalizaKruskal(grafo_bipartido, grafo_original, solucao *);
+int ComparaArestaKruskal(const void *, const void *);
+solucao CalibraLimiar(grafo_original, int, transporte *, topologia *, bool, int, int *, double *);
+bool ArquivoLimiar(char *, char *, int);
+int LeLimiar(char *);
+void GravaLimiar(char *, int);
+grafo_original SubGrafo(grafo_original, int *, int);
+solucao EncontraSolucaoSubGrafo(grafo_original, int *, int, int);
+solucao EncontraSolucaoDistribuida(grafo_original, int, transporte *, topologia *, bool, int, int);
+int ComparaInt(const void *, const void *);
+double Relogio(void);
+int Unix_Abre(canal *);
+int Unix_Envia(canal *, int, const void *, size_t);
+int Unix_Recebe(canal *, int, void *, size_t);
+void Unix_Fecha(canal *, int);
+transporte *BuscaTransporte(char *);
+int *OrdenaVertices(grafo_original, int);
+grafo_original ReordenaGrafo(grafo_original, int *, int *);
+void MedeLocalidade(grafo_original, double *, double *);
+topologia LeTopologia(void);
+unsigned long long HashBytes(unsigned long long, const void *, size_t);
+void CacheArquivo(char *, char *, unsigned long long);
+bool CacheBusca(char *, unsigned long long, grafo_original, solucao *);
+void CacheGuarda(char *, long long, unsigned long long, grafo_original, solucao);
+void CacheLimpa(char *, long long);
+int ComparaEntradaCache(const void *, const void *);
+int NoDaCPU(int);
+int NoAtual(void);
+void PosicionaProcesso(topologia *, int, bool, int);
+void IntercalaMemoria(topologia *);
+long TamanhoCacheLLC(void);
+void MedeBanda(topologia *, estat_no *, volatile int *, int);
+
+// Transportes disponíveis; o primeiro é o padrão
+transporte transportes[] = {
+	{"unix", Unix_Abre, Unix_Envia, Unix_Recebe, Unix_Fecha}
+};
 
 // Função Principal
 int main (int argc, char** argv){
-	grafo_original GO;
-	grafo_bipartido GB, H;
-	strut S;
+	grafo_original GO, GR, GS;
+	solucao Sol;
 	double tempoTotal, tempo1, tempo2;
 	double tempo1p, tempo2p;
-	int *SolutionEdgeSet;
-	int SolutionSize, i, j, k;
-	int it;
-	double SolutionVal;
-	int num_zerodiff;
-	uc *CD;
-	int x, y;
+	int i;
+	bool mostraArestas;
+	int num_processos;
+	transporte *T;
+	int reordena;
+	int *novo, *ordem;
+	bool pin;
+	int numa;
+	topologia Tp;
+	char *dirCache;
+	long long limiteCache;
+	unsigned long long hash;
+	bool achou;
+	int limiar;
+	bool calibra, limiarAuto;
+	char arqLimiar[4096];
+	estat_no en;
+	double dist1, dist2, prox1, prox2;
 	FILE *Arq;
 	
 	// Passo 1: Verificação de parâmetros
@@ -143,51 +323,302 @@ int main (int argc, char** argv){
 	
 	//Verificando os parametros
 	if(argc < 3 ){
-	   printf( "\nParametros incorretos\n Uso: ./cms_seq.exe <ArqEntrada> <ArqSaida onde:\n" );
+	   printf( "\nParametros incorretos\n Uso: ./cms_seq.exe <ArqEntrada> <ArqSaida> [S ou N] [opções] onde:\n" );
 	   printf( "\t <ArqEntrada> (obrigatorio) - Nome do arquivo com as informações do grafo (número de vértices, número de arestas e custos das arestas.\n" );
 		printf( "\t <ArqSaida> (obrigatorio) - Nome do arquivo de saida.\n" );
 		printf( "\t <S ou N> - Mostrar ou não as arestas da MST.\n" );
+		printf( "\t --processos <N> - Divide as arestas entre N processos e une as florestas locais em árvore.\n" );
+		printf( "\t --transporte <nome> - Transporte entre os processos (unix).\n" );
+		printf( "\t --pin - Fixa cada processo em um núcleo.\n" );
+		printf( "\t --numa <local ou intercalada> - Posicionamento da memória nos nós NUMA.\n" );
+		printf( "\t --cache <diretório> - Reaproveita a solução de grafos idênticos já resolvidos.\n" );
+		printf( "\t --cache-max <MB> - Tamanho máximo do cache (padrão 256).\n" );
+		printf( "\t --limiar <N ou auto> - Termina com Kruskal sequencial quando restarem até N arestas ou N fragmentos (auto: o limiar calibrado no diretório de cache).\n" );
+		printf( "\t --calibra - Mede alguns limiares sobre o grafo de entrada; com --cache grava o mais rápido para --limiar auto.\n" );
+		printf( "\t --reordena <bfs ou grau> - Renumera os vértices antes de criar o grafo bipartido.\n" );
 
 		return 0;
 	} 	
 	
+	mostraArestas = false;
+	num_processos = 1;
+	T = &transportes[0];
+	reordena = REORDENA_NENHUM;
+	pin = false;
+	numa = NUMA_PADRAO;
+	dirCache = NULL;
+	limiteCache = 256LL << 20;
+	limiar = 0;
+	limiarAuto = false;
+	calibra = false;
+	for(i = 3; i < argc; i++)
+	{
+		if((strcmp(argv[i], "--processos") == 0) && (i+1 < argc))
+			num_processos = atoi(argv[++i]);
+		else if((strcmp(argv[i], "--transporte") == 0) && (i+1 < argc))
+		{
+			T = BuscaTransporte(argv[++i]);
+			if(T == NULL)
+			{
+				printf("Transporte desconhecido: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if((strcmp(argv[i], "--reordena") == 0) && (i+1 < argc))
+		{
+			i++;
+			if(strcmp(argv[i], "bfs") == 0)
+				reordena = REORDENA_BFS;
+			else if(strcmp(argv[i], "grau") == 0)
+				reordena = REORDENA_GRAU;
+			else
+			{
+				printf("Critério de reordenação desconhecido: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if((strcmp(argv[i], "--cache") == 0) && (i+1 < argc))
+			dirCache = argv[++i];
+		else if((strcmp(argv[i], "--cache-max") == 0) && (i+1 < argc))
+			limiteCache = atoll(argv[++i]) << 20;
+		else if((strcmp(argv[i], "--limiar") == 0) && (i+1 < argc))
+		{
+			i++;
+			if(strcmp(argv[i], "auto") == 0)
+				limiarAuto = true;
+			else
+				limiar = atoi(argv[i]);
+		}
+		else if(strcmp(argv[i], "--calibra") == 0)
+			calibra = true;
+		else if(strcmp(argv[i], "--pin") == 0)
+			pin = true;
+		else if((strcmp(argv[i], "--numa") == 0) && (i+1 < argc))
+		{
+			i++;
+			if(strcmp(argv[i], "local") == 0)
+				numa = NUMA_LOCAL;
+			else if(strcmp(argv[i], "intercalada") == 0)
+				numa = NUMA_INTERCALADA;
+			else
+			{
+				printf("Posicionamento NUMA desconhecido: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(argv[i][0] == 'S' || argv[i][0] == 's')
+			mostraArestas = true;
+	}
+	if(num_processos < 1)
+		num_processos = 1;
+	
+	// --limiar auto usa o limiar gravado no cache pela última calibração com este número de processos
+	if(limiarAuto && !calibra)
+	{
+		if(!ArquivoLimiar(arqLimiar, dirCache, num_processos))
+			printf("--limiar auto requer --cache; usando limiar 0\n");
+		else if((limiar = LeLimiar(arqLimiar)) >= 0)
+			printf("Limiar lido de %s: %d\n", arqLimiar, limiar);
+		else
+		{
+			printf("Nenhum limiar calibrado em %s; usando limiar 0\n", arqLimiar);
+			limiar = 0;
+		}
+	}
+	
+	// O grafo de entrada é tocado primeiro pelo processo principal: com a 
+	// política intercalada suas páginas ficam espalhadas por todos os nós
+	Tp = LeTopologia();
+	if(numa == NUMA_INTERCALADA)
+		IntercalaMemoria(&Tp);
+	if(num_processos == 1 && (pin || numa == NUMA_LOCAL))
+		PosicionaProcesso(&Tp, 0, pin, numa);
+	if(num_processos == 1 && (pin || numa != NUMA_PADRAO))
+	{
+		MedeBanda(&Tp, &en, NULL, 1);
+		printf("Nó %d: leitura de %ld bytes a %.1lf MB/s\n", en.no, en.bytes, (en.fim > en.inicio) ? en.bytes / (en.fim - en.inicio) / 1e6 : 0);
+	}
+	
 	// ==============================================================================
 	// Passo 2: Leitura dos dados do Grafo G
 	// ==============================================================================
 	tempo1p = (double) clock( ) / CLOCKS_PER_SEC;
-	GO = LeGrafo(argv[1]);
+	GO = LeGrafo(argv[1], &hash);
 	//MostraGrafoOriginal(GO);
   	printf("Grafo de entrada lido\n");
-	SolutionEdgeSet = (int *) malloc((GO.n-1)*sizeof(int)); 
-	SolutionSize = 0;
-	SolutionVal = 0;
 	tempo2p = (double) clock( ) / CLOCKS_PER_SEC;
 	printf("Tempo Passo 2: %lf\n", tempo2p - tempo1p);
 	
+	// ==============================================================================
+	// Passo 2.1: Consulta ao cache de resultados (opcional)
+	// ==============================================================================
+	achou = false;
+	tempoTotal = 0;
+	if(dirCache != NULL && !calibra)
+	{
+		achou = CacheBusca(dirCache, hash, GO, &Sol);
+		printf("Cache %016llx: %s\n", hash, achou ? "encontrado" : "não encontrado");
+	}
+	
+	if(!achou)
+	{
+		// ==============================================================================
+		// Passo 2.2: Reordenação dos vértices (opcional)
+		// ==============================================================================
+		GS = GO;
+		ordem = NULL;
+		if(reordena != REORDENA_NENHUM)
+		{
+			tempo1p = Relogio();
+			novo = OrdenaVertices(GO, reordena);
+			ordem = (int *) malloc((GO.m > 0 ? GO.m : 1)*sizeof(int)); 
+			GR = ReordenaGrafo(GO, novo, ordem);
+			free(novo);
+			tempo2p = Relogio();
+			MedeLocalidade(GO, &dist1, &prox1);
+			MedeLocalidade(GR, &dist2, &prox2);
+			printf("Tempo Passo 2.2: %lf\n", tempo2p - tempo1p);
+			printf("\t Distância média entre vértices acessados em sequência: %.1lf -> %.1lf\n", dist1, dist2);
+			printf("\t Acessos na mesma linha de cache do anterior: %.1lf%% -> %.1lf%%\n", 100*prox1, 100*prox2);
+			GS = GR;
+		}
+		
+		// ==============================================================================
+		// Passos 3 e 4: Transforma em grafo bipartido e encontra a solução
+		// ==============================================================================
+		if(calibra)
+		{
+			// A solução e o tempo são os da execução mais rápida da calibração
+			Sol = CalibraLimiar(GS, num_processos, T, &Tp, pin, numa, &limiar, &tempoTotal);
+		}
+		else
+		{
+			//Iniciando contagem do tempo
+			tempo1 = Relogio();
+			if(num_processos > 1)
+				Sol = EncontraSolucaoDistribuida(GS, num_processos, T, &Tp, pin, numa, limiar);
+			else
+				Sol = EncontraSolucao(GS, true, limiar);
+			tempo2 = Relogio();
+			tempoTotal = tempo2 - tempo1;
+		}
+		
+		// Volta para as arestas (e os rótulos) do grafo de entrada
+		if(ordem != NULL)
+		{
+			for(i = 0; i < Sol.tam; i++)
+				Sol.arestas[i] = ordem[Sol.arestas[i]];
+			free(ordem);
+			free(GR.arestas);
+		}
+		
+		if(dirCache != NULL)
+			CacheGuarda(dirCache, limiteCache, hash, GO, Sol);
+		// CacheGuarda já criou o diretório
+		if(calibra && ArquivoLimiar(arqLimiar, dirCache, num_processos))
+			GravaLimiar(arqLimiar, limiar);
+	}
+
+	printf("\nCusto total da MST: %lf\n", Sol.custo);
+	printf("Número de árvores da floresta: %d\n", GO.n - Sol.tam);
+	printf("Tempo Total: %lf\n", tempoTotal); 
+
+	Arq = fopen(argv[2], "a");
+ 	fprintf(Arq, "\n*** Arquivo de entrada: %s\n", argv[1]); 
+	fprintf(Arq, "*** Custo total da MST: %lf\n", Sol.custo);
+	fprintf(Arq, "Tempo Total: %lf\n", tempoTotal); 
+	if(achou)
+		fprintf(Arq, "Solução obtida do cache %s\n", dirCache);
+	fprintf(Arq, "Número de iterações: %d\n", Sol.it);
+	if(limiar > 0)
+		fprintf(Arq, "Limiar para o Kruskal final: %d arestas ou fragmentos\n", limiar);
+	fprintf(Arq, "SolutionSize: %d\n", Sol.tam);
+	fprintf(Arq, "Número de árvores da floresta: %d\n", GO.n - Sol.tam);
+	if(num_processos > 1)
+		fprintf(Arq, "Número de processos: %d (transporte %s)\n", num_processos, T->nome);
+
+  	if(mostraArestas)
+	{
+  		fprintf(Arq, "*** MST formada pelas %d arestas\n", Sol.tam);
+  		for(i = 0; i < Sol.tam; i++)
+  			fprintf(Arq, "Aresta %d - %d = %lf\n", GO.arestas[Sol.arestas[i]].v, GO.arestas[Sol.arestas[i]].u, GO.arestas[Sol.arestas[i]].custo);
+  	}
+  	fclose(Arq);
+
+	
+	free(Sol.arestas);
+	free(GO.arestas);
+	free(Tp.cpus);
+	free(Tp.no);
+	
+	return 0;
+
+}
+
+
+// ==============================================================================
+// Função EncontraSolucao:  Executa o algoritmo da strut sobre o grafo GO e 
+//                          devolve os índices das arestas da floresta geradora
+//                          mínima; com limiar > 0 as últimas iterações (até 
+//                          limiar arestas ou limiar fragmentos) são trocadas 
+//                          por um Kruskal sequencial
+// ==============================================================================
+solucao EncontraSolucao(grafo_original GO, bool mostra, int limiar)
+{
+	grafo_bipartido GB, H;
+	strut S;
+	solucao Sol;
+	double tempo1p, tempo2p;
+	int i;
+	int num_zerodiff;
+	uc *CD;
+	int x, y;
+	
+	Sol.arestas = (int *) malloc((GO.n > 1 ? GO.n-1 : 1)*sizeof(int)); 
+	Sol.tam = 0;
+	Sol.custo = 0;
+	
 	// ==============================================================================
 	// Passo 3: Transforma em grafo bipartido
 	// ==============================================================================
-	//Iniciando contagem do tempo
-	tempo1 = (double) clock( ) / CLOCKS_PER_SEC;
 	tempo1p = (double) clock( ) / CLOCKS_PER_SEC;
 	GB = CriaGrafoBipartido(GO);
 //   	printf("Grafo bipartido gerado\n");
 	
 // 	printf("Grafo bipartido inicial ordenado\n");
 	tempo2p = (double) clock( ) / CLOCKS_PER_SEC;
-	printf("Tempo Passo 3: %lf\n", tempo2p - tempo1p);
+	if(mostra)
+		printf("Tempo Passo 3: %lf\n", tempo2p - tempo1p);
 
 	// ==============================================================================
 	// Passo 4: Encontra solução
 	// ==============================================================================
 	
-	it = 0;
+	Sol.it = 0;
 	num_zerodiff = 0;
-	while (SolutionSize < (GO.n-1))
+	// Para grafos desconexos o laço termina quando não restam arestas entre fragmentos
+	while ((Sol.tam < (GO.n-1)) && (GB.m > 0))
 	{
-   		printf("***** Iteração %d ****\n", it);
-   		printf("\t Número de fragmentos = %d   Número de arestas = %d    SolutionSize = %d    SolutionVal = %lf\n", GB.n_v, GB.m, SolutionSize, SolutionVal);
+		if(mostra)
+		{
+	   		printf("***** Iteração %d ****\n", Sol.it);
+	   		printf("\t Número de fragmentos = %d   Número de arestas = %d    SolutionSize = %d    SolutionVal = %lf\n", GB.n_v, GB.m, Sol.tam, Sol.custo);
+		}
 
+		// ==============================================================================
+		// Passo 4.4: Grafo contraído pequeno, onde cada iteração custa sobretudo a
+		// compactação e as duas ordenações: termina com Kruskal
+		// ==============================================================================
+		if(GB.n_u <= limiar || GB.n_v <= limiar)
+		{
+			tempo1p = (double) clock( ) / CLOCKS_PER_SEC;
+			FinalizaKruskal(GB, GO, &Sol);
+			tempo2p = (double) clock( ) / CLOCKS_PER_SEC;
+			if(mostra)
+				printf("Tempo Passo 4.4 (Kruskal com %d fragmentos e %d arestas): %lf\n", GB.n_v, GB.n_u, tempo2p - tempo1p);
+			Sol.it++;
+			break;
+		}
 		
 		//MostraGrafoBipartido(GB, GO, true);
 		
@@ -209,7 +640,8 @@ int main (int argc, char** argv){
 		S = GeraStrut(GB);
 //   		printf("Strut gerada\n");
 		tempo2p = (double) clock( ) / CLOCKS_PER_SEC;
-		printf("Tempo Passo 4.1: %lf\n", tempo2p - tempo1p);
+		if(mostra)
+			printf("Tempo Passo 4.1: %lf\n", tempo2p - tempo1p);
 		
 		// ==============================================================================
 		// Passo 4.2: Calcular o num_zero_diff e computa novas componenetes conexas
@@ -226,10 +658,10 @@ int main (int argc, char** argv){
 		{
 			if(S.vertices_u[i].grau > 0)
 			{
-				SolutionEdgeSet[SolutionSize] = S.vertices_u[i].ind_ago;
-// 				printf("%d Adicionada aresta: %d - %d com custo %lf\n", S.vertices_u[i].grau, GO.arestas[SolutionEdgeSet[SolutionSize]].v, GO.arestas[SolutionEdgeSet[SolutionSize]].u, GO.arestas[SolutionEdgeSet[SolutionSize]].custo);
-				SolutionVal += GO.arestas[S.vertices_u[i].ind_ago].custo;
-				SolutionSize++;
+				Sol.arestas[Sol.tam] = S.vertices_u[i].ind_ago;
+// 				printf("%d Adicionada aresta: %d - %d com custo %lf\n", S.vertices_u[i].grau, GO.arestas[Sol.arestas[Sol.tam]].v, GO.arestas[Sol.arestas[Sol.tam]].u, GO.arestas[Sol.arestas[Sol.tam]].custo);
+				Sol.custo += GO.arestas[S.vertices_u[i].ind_ago].custo;
+				Sol.tam++;
 				if (S.vertices_u[i].grau == 2)
 					num_zerodiff++;
 					
@@ -248,7 +680,8 @@ int main (int argc, char** argv){
 		free(S.arestas);
 
 		tempo2p = (double) clock( ) / CLOCKS_PER_SEC;
-		printf("Tempo Passo 4.2: %lf\n", tempo2p - tempo1p);
+		if(mostra)
+			printf("Tempo Passo 4.2: %lf\n", tempo2p - tempo1p);
 		
 //  		printf("== CD Atualizado ===\n");
 		//for(i =0; i < GB.n_v; i++)
@@ -256,57 +689,201 @@ int main (int argc, char** argv){
 		// ==============================================================================
 		// Passo 4.3: Compactar o grafo
 		// ==============================================================================
-		if(SolutionSize < (GO.n-1))
+		if(Sol.tam < (GO.n-1))
 		{
 			tempo1p = (double) clock( ) / CLOCKS_PER_SEC;
 			H = CompactarGrafo(GB, GO, CD, num_zerodiff);
 //  			printf("Grafo compactado\n");
 			GB = H;
 			tempo2p = (double) clock( ) / CLOCKS_PER_SEC;
-			printf("Tempo Passo 4.3: %lf\n", tempo2p - tempo1p);		
+			if(mostra)
+				printf("Tempo Passo 4.3: %lf\n", tempo2p - tempo1p);		
 		}
 		
 		free(CD);
-		it++;
+		Sol.it++;
 	} // fim while
-	tempo2 = (double) clock( ) / CLOCKS_PER_SEC;
-	tempoTotal = tempo2 - tempo1;
 
-	printf("***** Iteração %d ****\n", it);
-	printf("\t Número de fragmentos = %d   Número de arestas = %d    SolutionSize = %d    SolutionVal = %lf\n", GB.n_v, GB.m, SolutionSize, SolutionVal);
-	printf("\nCusto total da MST: %lf\n", SolutionVal);
-	printf("Tempo Total: %lf\n", tempoTotal); 
+	if(mostra)
+	{
+		printf("***** Iteração %d ****\n", Sol.it);
+		printf("\t Número de fragmentos = %d   Número de arestas = %d    SolutionSize = %d    SolutionVal = %lf\n", GB.n_v, GB.m, Sol.tam, Sol.custo);
+	}
+	
+	free(GB.vertices_v);
+	free(GB.vertices_u);
+	free(GB.arestas);
+	
+	return Sol;
+}
 
-	Arq = fopen(argv[2], "a");
- 	fprintf(Arq, "\n*** Arquivo de entrada: %s\n", argv[1]); 
-	fprintf(Arq, "*** Custo total da MST: %lf\n", SolutionVal);
-	fprintf(Arq, "Tempo Total: %lf\n", tempoTotal); 
-	fprintf(Arq, "Número de iterações: %d\n", it);
-	fprintf(Arq, "SolutionSize: %d\n", SolutionSize);
 
-  	if((argc == 4) && (argv[3][0] == 'S' || argv[3][0] == 's'))
+// ==============================================================================
+// Função FinalizaKruskal:  Completa a solução com o Kruskal sobre o grafo 
+//                          bipartido contraído: cada vértice u é uma aresta 
+//                          entre os dois fragmentos (vértices v) adjacentes
+// ==============================================================================
+void FinalizaKruskal(grafo_bipartido GB, grafo_original GO, solucao *Sol)
+{
+	aresta_kruskal *A;
+	int *v1, *v2;
+	uc *CD;
+	int i, x, y;
+	
+	v1 = (int *) malloc(GB.n_u*sizeof(int)); 
+	v2 = (int *) malloc(GB.n_u*sizeof(int)); 
+	A = (aresta_kruskal *) malloc(GB.n_u*sizeof(aresta_kruskal)); 
+	for(i = 0; i < GB.n_u; i++)
+		v1[i] = -1;
+	for(i = 0; i < GB.m; i++)
 	{
-  		fprintf(Arq, "*** MST formada pelas %d arestas\n", SolutionSize);
-  		for(i = 0; i < SolutionSize; i++)
-  			fprintf(Arq, "Aresta %d - %d = %lf\n", GO.arestas[SolutionEdgeSet[i]].v, GO.arestas[SolutionEdgeSet[i]].u, GO.arestas[SolutionEdgeSet[i]].custo);
-  	}
-  	fclose(Arq);
+		if(v1[GB.arestas[i].ind_u] == -1)
+			v1[GB.arestas[i].ind_u] = GB.arestas[i].ind_v;
+		else
+			v2[GB.arestas[i].ind_u] = GB.arestas[i].ind_v;
+	}
+	for(i = 0; i < GB.n_u; i++)
+	{
+		A[i].custo = GO.arestas[GB.vertices_u[i].ind_ago].custo;
+		A[i].ind_u = i;
+	}
+	qsort(A, GB.n_u, sizeof(aresta_kruskal), ComparaArestaKruskal);
+	
+	CD = (uc *) malloc(GB.n_v*sizeof(uc)); 
+	CD_Inic(GB.n_v, CD);
+	for(i = 0; i < GB.n_u && Sol->tam < GO.n-1; i++)
+	{
+		x = CD_chefe(v1[A[i].ind_u], CD);
+		y = CD_chefe(v2[A[i].ind_u], CD);
+		if(x != y)
+		{
+			CD_Uniao(x, y, CD);
+			Sol->arestas[Sol->tam] = GB.vertices_u[A[i].ind_u].ind_ago;
+			Sol->custo += A[i].custo;
+			Sol->tam++;
+		}
+	}
+	
+	free(CD);
+	free(A);
+	free(v2);
+	free(v1);
+}
 
+
+int ComparaArestaKruskal(const void *a, const void *b)
+{
+	const aresta_kruskal *x = (const aresta_kruskal *) a;
+	const aresta_kruskal *y = (const aresta_kruskal *) b;
 	
-	free(SolutionEdgeSet);
+	if(x->custo != y->custo)
+		return (x->custo > y->custo) - (x->custo < y->custo);
+	return (x->ind_u > y->ind_u) - (x->ind_u < y->ind_u);
+}
+
+
+// Função CalibraLimiar:  Resolve GO com alguns limiares (0 e potências de 4 
+//                        abaixo do número de arestas e de vértices: a partir 
+//                        daí o Kruskal começaria na primeira iteração), 3 vezes
+//                        cada, pelo mesmo caminho
+//                        da execução normal (P processos); limiar e tempo 
+//                        recebem os da execução mais rápida, cuja solução é 
+//                        devolvida
+// ==============================================================================
+solucao CalibraLimiar(grafo_original GO, int P, transporte *T, topologia *Tp, bool pin, int numa, int *limiar, double *tempo)
+{
+	solucao Sol, Melhor;
+	double t, t_lim;
+	int l, r;
 	
-	return 0;
+	printf("Calibração do limiar para o Kruskal final\n");
+	Melhor.arestas = NULL;
+	*limiar = 0;
+	*tempo = -1;
+	for(l = 0; l == 0 || (l < GO.m && l < GO.n); l = (l == 0) ? 64 : 4*l)
+	{
+		t_lim = -1;
+		for(r = 0; r < 3; r++)
+		{
+			t = Relogio();
+			if(P > 1)
+				Sol = EncontraSolucaoDistribuida(GO, P, T, Tp, pin, numa, l);
+			else
+				Sol = EncontraSolucao(GO, false, l);
+			t = Relogio() - t;
+			if(t_lim < 0 || t < t_lim)
+				t_lim = t;
+			if(*tempo < 0 || t < *tempo)
+			{
+				free(Melhor.arestas);
+				Melhor = Sol;
+				*limiar = l;
+				*tempo = t;
+			}
+			else
+				free(Sol.arestas);
+		}
+		printf("\t Limiar %d: %lf\n", l, t_lim);
+	}
+	printf("\t Limiar escolhido: %d\n", *limiar);
+	return Melhor;
+}
+
+
+// ==============================================================================
+// Função ArquivoLimiar:  Caminho do limiar calibrado para P processos, no 
+//                        diretório de cache (falso sem --cache)
+// ==============================================================================
+bool ArquivoLimiar(char *caminho, char *dir, int P)
+{
+	if(dir == NULL || strlen(dir) >= 4000)
+		return false;
+	sprintf(caminho, "%s/limiar.%d", dir, P);
+	return true;
+}
+
 
+// Devolve -1 se o arquivo não existe ou não contém um limiar válido
+int LeLimiar(char *caminho)
+{
+	FILE *Arq;
+	int limiar;
+	
+	Arq = fopen(caminho, "r");
+	if(Arq == NULL)
+		return -1;
+	if(fscanf(Arq, "%d", &limiar) != 1 || limiar < 0)
+		limiar = -1;
+	fclose(Arq);
+	return limiar;
+}
+
+
+void GravaLimiar(char *caminho, int limiar)
+{
+	FILE *Arq;
+	
+	Arq = fopen(caminho, "w");
+	if(Arq == NULL)
+	{
+		perror(caminho);
+		return;
+	}
+	fprintf(Arq, "%d\n", limiar);
+	fclose(Arq);
+	printf("Limiar gravado em %s\n", caminho);
 }
 
 
 // ==============================================================================
 // Função LeGrafo:  Lê as informações do Grafo de um arquivo e armazena em uma 
-//                  estrutura
+//                  estrutura; hash recebe o FNV-1a da lista de arestas já 
+//                  normalizada (v <= u, custo em binário), chave do cache
 // ==============================================================================
-grafo_original LeGrafo(char *Arquivo){
+grafo_original LeGrafo(char *Arquivo, unsigned long long *hash){
 	int i, aux;
 	grafo_original G;
+	unsigned long long h;
    FILE *Arq;
     
    Arq = fopen(Arquivo, "r");
@@ -318,6 +895,10 @@ grafo_original LeGrafo(char *Arquivo){
 	fscanf(Arq,"%d",&i);
 	G.m = i;
 	
+	h = HASH_INICIAL;
+	h = HashBytes(h, &G.n, sizeof(int));
+	h = HashBytes(h, &G.m, sizeof(int));
+	
 	G.arestas = (aresta_go *) malloc(G.m*sizeof(aresta_go)); 
 	for(i = 0; i < G.m; i++){
 		fscanf(Arq,"%hu",&G.arestas[i].u);
@@ -329,9 +910,13 @@ grafo_original LeGrafo(char *Arquivo){
 			G.arestas[i].u = aux;
 		}
 		fscanf(Arq,"%f",&G.arestas[i].custo);
+		h = HashBytes(h, &G.arestas[i].v, sizeof(unsigned short));
+		h = HashBytes(h, &G.arestas[i].u, sizeof(unsigned short));
+		h = HashBytes(h, &G.arestas[i].custo, sizeof(float));
 	}
 	
 	fclose(Arq);
+	*hash = h;
    return G;
 }
 
@@ -555,6 +1140,8 @@ strut GeraStrut(grafo_bipartido G)
 	
  	for(i = 0; i < S.m; i++){
 		j = G.vertices_v[i].menorAresta;
+		if(j == -1) // Vértice isolado (grafo desconexo): não contribui para a strut
+			continue;
 		S.arestas[i].ind_v = G.arestas[j].ind_v;
 		S.arestas[i].ind_u = G.arestas[j].ind_u;
 		S.arestas[i].ind_acgb =  G.arestas[j].ind_ac;
@@ -746,6 +1333,8 @@ grafo_bipartido CompactarGrafo(grafo_bipartido G, grafo_original GO, uc *CD, int
   		//printf("Adicionada a aresta %d \t ind_v = %d \t ind_u = %d \t ind_ac = %d\n", i, GC.arestas[i].ind_v, GC.arestas[i].ind_u, GC.arestas[i].ind_ac);
   	}
 	GC.arestas = G.arestas;
+	// Em grafos desconexos os fragmentos já completos não têm mais arestas e saem do grafo
+	GC.n_v = aux + 1;
 	
 	free(G.vertices_v);
 // 	printf("G.vertices_v liberado\n");
@@ -793,4 +1382,958 @@ void CD_Uniao(int x, int y, uc *CD) {
 		CD[y].ch = x; 
 		CD[x].tam += CD[y].tam; 
    }
-}
\ No newline at end of file
+}
+
+
+
+// ==============================================================================
+// Função SubGrafo:  Cria um grafo com os mesmos vértices de GO e apenas as 
+//                   arestas cujos índices estão em ind (em ordem crescente)
+// ==============================================================================
+grafo_original SubGrafo(grafo_original GO, int *ind, int m)
+{
+	grafo_original G;
+	int i;
+	
+	G.n = GO.n;
+	G.m = m;
+	G.arestas = (aresta_go *) malloc((m > 0 ? m : 1)*sizeof(aresta_go)); 
+	for(i = 0; i < m; i++)
+		G.arestas[i] = GO.arestas[ind[i]];
+	return G;
+}
+
+
+// ==============================================================================
+// Função EncontraSolucaoSubGrafo:  Encontra a floresta do subgrafo formado pelas 
+//                                  arestas ind e devolve os índices das arestas 
+//                                  de GO em ordem crescente
+// ==============================================================================
+solucao EncontraSolucaoSubGrafo(grafo_original GO, int *ind, int m, int limiar)
+{
+	grafo_original G;
+	solucao Sol;
+	int i;
+	
+	G = SubGrafo(GO, ind, m);
+	Sol = EncontraSolucao(G, false, limiar);
+	for(i = 0; i < Sol.tam; i++)
+		Sol.arestas[i] = ind[Sol.arestas[i]];
+	// Mantém a ordem das arestas de GO, exigida por CompactarGrafo
+	qsort(Sol.arestas, Sol.tam, sizeof(int), ComparaInt);
+	free(G.arestas);
+	return Sol;
+}
+
+
+// ==============================================================================
+// Função EncontraSolucaoDistribuida:  Divide as arestas de GO entre P processos,
+//                                     cada um calcula a floresta da sua parte e
+//                                     as florestas são unidas em árvore: na rodada
+//                                     r o processo k recebe a floresta de k + 2^r
+// ==============================================================================
+solucao EncontraSolucaoDistribuida(grafo_original GO, int P, transporte *T, topologia *Tp, bool pin, int numa, int limiar)
+{
+	grafo_original G;
+	solucao Sol;
+	canal *coord, *red;
+	estat_rodada *est, *total;
+	estat_no en, *nos;
+	int *uniao;
+	int R, r, k, s, i, j, passo, ini, fim, m2;
+	double t1, t2, tl;
+	volatile int *barreira;
+	pid_t pid;
+	
+	for(R = 0, passo = 1; passo < P; passo *= 2)
+		R++;
+	
+	// coord[k] liga o processo k ao coordenador (lado 0) e red[s] liga o 
+	// processo s (lado 1) ao processo que recebe sua floresta (lado 0)
+	coord = (canal *) malloc(P*sizeof(canal)); 
+	red = (canal *) malloc(P*sizeof(canal)); 
+	for(k = 0; k < P; k++)
+	{
+		if(T->abre(&coord[k]) != 0 || (k > 0 && T->abre(&red[k]) != 0))
+		{
+			perror("transporte");
+			exit(1);
+		}
+	}
+	
+	// Com --pin ou --numa os processos medem a banda juntos: barreira em memória compartilhada
+	barreira = NULL;
+	if(pin || numa != NUMA_PADRAO)
+	{
+		barreira = (volatile int *) mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if(barreira == MAP_FAILED)
+			barreira = NULL;
+		else
+			*barreira = 0;
+	}
+	
+	for(k = 0; k < P; k++)
+	{
+		pid = fork();
+		if(pid < 0)
+		{
+			perror("fork");
+			exit(1);
+		}
+		if(pid > 0)
+			continue;
+		
+		// Processo k
+		for(s = 0; s < P; s++)
+		{
+			T->fecha(&coord[s], 0);
+			if(s != k)
+				T->fecha(&coord[s], 1);
+			if(s > 0)
+			{
+				if(s != k)
+					T->fecha(&red[s], 1);
+				if(s - (s & -s) != k)
+					T->fecha(&red[s], 0);
+			}
+		}
+		
+		// Fixa o processo antes de alocar: a primeira escrita define o nó das páginas
+		if(pin || numa == NUMA_LOCAL)
+			PosicionaProcesso(Tp, k, pin, numa);
+		memset(&en, 0, sizeof(en));
+		if(barreira != NULL)
+			MedeBanda(Tp, &en, barreira, P);
+		est = (estat_rodada *) calloc(R+1, sizeof(estat_rodada)); 
+		
+		// Floresta local sobre o bloco de arestas [ini, fim)
+		t1 = Relogio();
+		ini = (int) ((long) GO.m * k / P);
+		fim = (int) ((long) GO.m * (k+1) / P);
+		G.n = GO.n;
+		G.m = fim - ini;
+		G.arestas = (aresta_go *) malloc((G.m > 0 ? G.m : 1)*sizeof(aresta_go)); 
+		memcpy(G.arestas, GO.arestas + ini, G.m*sizeof(aresta_go));
+		Sol = EncontraSolucao(G, false, limiar);
+		free(G.arestas);
+		for(i = 0; i < Sol.tam; i++)
+			Sol.arestas[i] += ini;
+		qsort(Sol.arestas, Sol.tam, sizeof(int), ComparaInt);
+		tl = Relogio() - t1;
+		
+		for(r = 0, passo = 1; passo < P; passo *= 2, r++)
+		{
+			if(k % (2*passo) == passo)
+			{
+				// Envia a floresta e termina sua participação na redução
+				if(T->envia(&red[k], 1, &Sol.tam, sizeof(int)) != 0 || T->envia(&red[k], 1, Sol.arestas, Sol.tam*sizeof(int)) != 0)
+					_exit(1);
+				T->fecha(&red[k], 1);
+				break;
+			}
+			if(k + passo >= P)
+				continue;
+			
+			t1 = Relogio();
+			// Se o parceiro falhou o processo termina sem enviar resultados ao coordenador
+			if(T->recebe(&red[k+passo], 0, &m2, sizeof(int)) != 0 || m2 < 0 || m2 > GO.n-1)
+				_exit(1);
+			est[r].tempo_espera = Relogio() - t1;
+			t1 = Relogio();
+			uniao = (int *) malloc((Sol.tam + m2 > 0 ? Sol.tam + m2 : 1)*sizeof(int)); 
+			if(T->recebe(&red[k+passo], 0, uniao + Sol.tam, m2*sizeof(int)) != 0)
+				_exit(1);
+			T->fecha(&red[k+passo], 0);
+			t2 = Relogio();
+			est[r].bytes = (long) (m2 + 1)*sizeof(int);
+			est[r].tempo_com = t2 - t1;
+			
+			// Une as duas florestas, mantendo os índices em ordem crescente
+			for(i = 0; i < Sol.tam; i++)
+				uniao[i] = Sol.arestas[i];
+			qsort(uniao, Sol.tam + m2, sizeof(int), ComparaInt);
+			j = Sol.tam + m2;
+			free(Sol.arestas);
+			Sol = EncontraSolucaoSubGrafo(GO, uniao, j, limiar);
+			free(uniao);
+			est[r].tempo_uniao = Relogio() - t2;
+		}
+		
+		// Estatísticas (fase local na posição R) e, no processo 0, a solução final
+		est[R].tempo_uniao = tl;
+		if(T->envia(&coord[k], 1, est, (R+1)*sizeof(estat_rodada)) != 0 || T->envia(&coord[k], 1, &en, sizeof(estat_no)) != 0)
+			_exit(1);
+		if(k == 0)
+		{
+			if(T->envia(&coord[k], 1, &Sol.it, sizeof(int)) != 0 || T->envia(&coord[k], 1, &Sol.tam, sizeof(int)) != 0 || T->envia(&coord[k], 1, Sol.arestas, Sol.tam*sizeof(int)) != 0)
+				_exit(1);
+		}
+		T->fecha(&coord[k], 1);
+		_exit(0);
+	}
+	
+	// Coordenador
+	for(k = 0; k < P; k++)
+	{
+		T->fecha(&coord[k], 1);
+		if(k > 0)
+		{
+			T->fecha(&red[k], 0);
+			T->fecha(&red[k], 1);
+		}
+	}
+	
+	est = (estat_rodada *) malloc((R+1)*sizeof(estat_rodada)); 
+	total = (estat_rodada *) calloc(R+1, sizeof(estat_rodada)); 
+	nos = (estat_no *) calloc(Tp->n_nos, sizeof(estat_no)); 
+	Sol.arestas = (int *) malloc((GO.n > 1 ? GO.n-1 : 1)*sizeof(int)); 
+	Sol.tam = 0;
+	Sol.it = 0;
+	for(k = 0; k < P; k++)
+	{
+		if(T->recebe(&coord[k], 0, est, (R+1)*sizeof(estat_rodada)) != 0)
+		{
+			printf("Processo %d terminou sem enviar resultados\n", k);
+			exit(1);
+		}
+		for(r = 0; r <= R; r++)
+		{
+			total[r].bytes += est[r].bytes;
+			if(est[r].tempo_espera > total[r].tempo_espera)
+				total[r].tempo_espera = est[r].tempo_espera;
+			if(est[r].tempo_com > total[r].tempo_com)
+				total[r].tempo_com = est[r].tempo_com;
+			if(est[r].tempo_uniao > total[r].tempo_uniao)
+				total[r].tempo_uniao = est[r].tempo_uniao;
+		}
+		// Banda do nó: bytes somados sobre o intervalo entre o primeiro início e o último fim
+		if(T->recebe(&coord[k], 0, &en, sizeof(estat_no)) != 0)
+		{
+			printf("Processo %d terminou sem enviar resultados\n", k);
+			exit(1);
+		}
+		if(en.processos > 0 && en.no >= 0 && en.no < Tp->n_nos)
+		{
+			if(nos[en.no].processos == 0 || en.inicio < nos[en.no].inicio)
+				nos[en.no].inicio = en.inicio;
+			if(nos[en.no].processos == 0 || en.fim > nos[en.no].fim)
+				nos[en.no].fim = en.fim;
+			nos[en.no].processos += en.processos;
+			nos[en.no].bytes += en.bytes;
+		}
+		if(k == 0)
+		{
+			if(T->recebe(&coord[k], 0, &Sol.it, sizeof(int)) != 0 || T->recebe(&coord[k], 0, &Sol.tam, sizeof(int)) != 0 
+			   || Sol.tam < 0 || Sol.tam > GO.n-1 || T->recebe(&coord[k], 0, Sol.arestas, Sol.tam*sizeof(int)) != 0)
+			{
+				printf("Processo %d terminou sem enviar resultados\n", k);
+				exit(1);
+			}
+		}
+		T->fecha(&coord[k], 0);
+	}
+	for(k = 0; k < P; k++)
+		wait(NULL);
+	if(barreira != NULL)
+		munmap((void *) barreira, sizeof(int));
+	
+	Sol.custo = 0;
+	for(i = 0; i < Sol.tam; i++)
+		Sol.custo += GO.arestas[Sol.arestas[i]].custo;
+	
+	printf("Execução distribuída: %d processos, transporte %s\n", P, T->nome);
+	printf("\t Fase local: %lf s\n", total[R].tempo_uniao);
+	for(r = 0; r < R; r++)
+		printf("\t Rodada %d: %lf s de espera pelo parceiro, %ld bytes em %lf s de comunicação, %lf s de união\n", r+1, total[r].tempo_espera, total[r].bytes, total[r].tempo_com, total[r].tempo_uniao);
+	for(i = 0; i < Tp->n_nos; i++)
+		if(nos[i].processos > 0)
+			printf("\t Nó %d: %d processos, leitura de %ld bytes a %.1lf MB/s\n", i, nos[i].processos, nos[i].bytes, (nos[i].fim > nos[i].inicio) ? nos[i].bytes / (nos[i].fim - nos[i].inicio) / 1e6 : 0);
+	
+	free(est);
+	free(total);
+	free(nos);
+	free(coord);
+	free(red);
+	return Sol;
+}
+
+
+int ComparaInt(const void *a, const void *b)
+{
+	return (*(const int *) a > *(const int *) b) - (*(const int *) a < *(const int *) b);
+}
+
+
+// ==============================================================================
+// Função Relogio:  Tempo de parede em segundos (clock mede apenas a CPU do processo)
+// ==============================================================================
+double Relogio(void)
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+// ==============================================================================
+// Transporte unix:  Canal bidirecional entre processos locais com socketpair
+// ==============================================================================
+int Unix_Abre(canal *C)
+{
+	return socketpair(AF_UNIX, SOCK_STREAM, 0, C->fd);
+}
+
+int Unix_Envia(canal *C, int lado, const void *buf, size_t n)
+{
+	const char *p = (const char *) buf;
+	ssize_t k;
+	
+	while(n > 0)
+	{
+		k = write(C->fd[lado], p, n);
+		if(k <= 0)
+			return -1;
+		p += k;
+		n -= k;
+	}
+	return 0;
+}
+
+int Unix_Recebe(canal *C, int lado, void *buf, size_t n)
+{
+	char *p = (char *) buf;
+	ssize_t k;
+	
+	while(n > 0)
+	{
+		k = read(C->fd[lado], p, n);
+		if(k <= 0)
+			return -1;
+		p += k;
+		n -= k;
+	}
+	return 0;
+}
+
+void Unix_Fecha(canal *C, int lado)
+{
+	close(C->fd[lado]);
+}
+
+transporte *BuscaTransporte(char *nome)
+{
+	int i;
+	
+	for(i = 0; i < (int) (sizeof(transportes)/sizeof(transportes[0])); i++)
+		if(strcmp(transportes[i].nome, nome) == 0)
+			return &transportes[i];
+	return NULL;
+}
+
+
+
+// ==============================================================================
+// Função OrdenaVertices:  Calcula um novo rótulo para cada vértice de GO, em 
+//                         ordem de busca em largura ou de grau decrescente, 
+//                         para que vértices acessados juntos fiquem próximos
+// ==============================================================================
+int *OrdenaVertices(grafo_original GO, int criterio)
+{
+	int *novo, *grau, *ini, *adj, *fila;
+	int i, j, v, s, cab, fim;
+	
+	novo = (int *) malloc((GO.n > 0 ? GO.n : 1)*sizeof(int)); 
+	grau = (int *) calloc(GO.n + 1, sizeof(int)); 
+	for(i = 0; i < GO.m; i++)
+	{
+		grau[GO.arestas[i].v]++;
+		grau[GO.arestas[i].u]++;
+	}
+	
+	if(criterio == REORDENA_GRAU)
+	{
+		// CountSort pelo grau, do maior para o menor
+		ini = (int *) calloc(GO.n + 1, sizeof(int)); 
+		for(i = 0; i < GO.n; i++)
+			ini[GO.n - 1 - (grau[i] < GO.n ? grau[i] : GO.n - 1)]++;
+		for(i = 1; i < GO.n; i++)
+			ini[i] += ini[i-1];
+		for(i = GO.n-1; i >= 0; i--)
+			novo[i] = --ini[GO.n - 1 - (grau[i] < GO.n ? grau[i] : GO.n - 1)];
+		free(ini);
+		free(grau);
+		return novo;
+	}
+	
+	// Lista de adjacências compacta
+	ini = (int *) malloc((GO.n + 1)*sizeof(int)); 
+	adj = (int *) malloc((2*GO.m > 0 ? 2*GO.m : 1)*sizeof(int)); 
+	ini[0] = 0;
+	for(i = 0; i < GO.n; i++)
+		ini[i+1] = ini[i] + grau[i];
+	for(i = 0; i < GO.m; i++)
+	{
+		adj[ini[GO.arestas[i].v] + --grau[GO.arestas[i].v]] = GO.arestas[i].u;
+		adj[ini[GO.arestas[i].u] + --grau[GO.arestas[i].u]] = GO.arestas[i].v;
+	}
+	
+	// Busca em largura a partir de cada vértice ainda não visitado
+	fila = (int *) malloc((GO.n > 0 ? GO.n : 1)*sizeof(int)); 
+	for(i = 0; i < GO.n; i++)
+		novo[i] = -1;
+	fim = 0;
+	for(s = 0; s < GO.n; s++)
+	{
+		if(novo[s] != -1)
+			continue;
+		novo[s] = fim;
+		fila[fim++] = s;
+		for(cab = fim - 1; cab < fim; cab++)
+		{
+			v = fila[cab];
+			for(j = ini[v]; j < ini[v+1]; j++)
+				if(novo[adj[j]] == -1)
+				{
+					novo[adj[j]] = fim;
+					fila[fim++] = adj[j];
+				}
+		}
+	}
+	
+	free(fila);
+	free(adj);
+	free(ini);
+	free(grau);
+	return novo;
+}
+
+
+// ==============================================================================
+// Função ReordenaGrafo:  Renumera os vértices de GO conforme novo e ordena as 
+//                        arestas pelo primeiro vértice (CountSort); ordem[i] 
+//                        recebe o índice em GO da aresta i do novo grafo
+// ==============================================================================
+grafo_original ReordenaGrafo(grafo_original GO, int *novo, int *ordem)
+{
+	grafo_original G;
+	int *C;
+	int i, v, u;
+	
+	G.n = GO.n;
+	G.m = GO.m;
+	G.arestas = (aresta_go *) malloc((G.m > 0 ? G.m : 1)*sizeof(aresta_go)); 
+	C = (int *) calloc(G.n + 1, sizeof(int)); 
+	
+	for(i = 0; i < GO.m; i++)
+	{
+		v = novo[GO.arestas[i].v];
+		u = novo[GO.arestas[i].u];
+		C[v < u ? v : u]++;
+	}
+	for(i = 1; i < G.n; i++)
+		C[i] = C[i] + C[i-1];
+	
+	for(i = GO.m-1; i >= 0; i--)
+	{
+		v = novo[GO.arestas[i].v];
+		u = novo[GO.arestas[i].u];
+		if(v > u)
+		{
+			v = u;
+			u = novo[GO.arestas[i].v];
+		}
+		C[v]--;
+		G.arestas[C[v]].v = v;
+		G.arestas[C[v]].u = u;
+		G.arestas[C[v]].custo = GO.arestas[i].custo;
+		ordem[C[v]] = i;
+	}
+	
+	free(C);
+	return G;
+}
+
+
+// ==============================================================================
+// Função MedeLocalidade:  Percorre os vértices na ordem em que as arestas do 
+//                         grafo bipartido os acessam e mede a distância média 
+//                         entre acessos seguidos e a fração deles que cai na 
+//                         mesma linha de cache (64 bytes) de vertices_v
+// ==============================================================================
+void MedeLocalidade(grafo_original G, double *dist, double *prox)
+{
+	int i, ant, x;
+	long n_prox;
+	double soma;
+	
+	soma = 0;
+	n_prox = 0;
+	ant = -1;
+	for(i = 0; i < 2*G.m; i++)
+	{
+		x = (i % 2 == 0) ? G.arestas[i/2].v : G.arestas[i/2].u;
+		if(ant != -1)
+		{
+			soma += (x > ant) ? x - ant : ant - x;
+			if((x * sizeof(vertice_v)) / 64 == (ant * sizeof(vertice_v)) / 64)
+				n_prox++;
+		}
+		ant = x;
+	}
+	*dist = (G.m > 0) ? soma / (2*G.m - 1) : 0;
+	*prox = (G.m > 0) ? (double) n_prox / (2*G.m - 1) : 0;
+}
+
+
+
+// ==============================================================================
+// Função LeTopologia:  Lista as CPUs que o processo pode usar e o nó NUMA de 
+//                      cada uma; as CPUs são ordenadas alternando entre os nós
+//                      para que processos consecutivos fiquem em nós diferentes
+// ==============================================================================
+topologia LeTopologia(void)
+{
+	topologia Tp;
+	int *cpus, *no, *usada;
+	int i, j, n, r;
+	
+	Tp.n_nos = 1;
+#ifdef __linux__
+	cpu_set_t conj;
+	
+	CPU_ZERO(&conj);
+	sched_getaffinity(0, sizeof(conj), &conj);
+	n = CPU_COUNT(&conj);
+	cpus = (int *) malloc((n > 0 ? n : 1)*sizeof(int)); 
+	no = (int *) malloc((n > 0 ? n : 1)*sizeof(int)); 
+	for(i = j = 0; i < CPU_SETSIZE && j < n; i++)
+		if(CPU_ISSET(i, &conj))
+		{
+			cpus[j] = i;
+			no[j] = NoDaCPU(i);
+			if(no[j] + 1 > Tp.n_nos)
+				Tp.n_nos = no[j] + 1;
+			j++;
+		}
+#else
+	n = 1;
+	cpus = (int *) malloc(sizeof(int)); 
+	no = (int *) malloc(sizeof(int)); 
+	cpus[0] = 0;
+	no[0] = 0;
+#endif
+	
+	// r-ésima CPU de cada nó, para r = 0, 1, ...
+	Tp.n_cpus = n;
+	Tp.cpus = (int *) malloc((n > 0 ? n : 1)*sizeof(int)); 
+	Tp.no = (int *) malloc((n > 0 ? n : 1)*sizeof(int)); 
+	usada = (int *) calloc(n > 0 ? n : 1, sizeof(int)); 
+	for(j = 0; j < n; )
+		for(r = 0; r < Tp.n_nos; r++)
+			for(i = 0; i < n; i++)
+				if(!usada[i] && no[i] == r)
+				{
+					usada[i] = 1;
+					Tp.cpus[j] = cpus[i];
+					Tp.no[j] = no[i];
+					j++;
+					break;
+				}
+	
+	free(usada);
+	free(cpus);
+	free(no);
+	Tp.cache_llc = TamanhoCacheLLC();
+	return Tp;
+}
+
+
+// ==============================================================================
+// Função NoDaCPU:  Nó NUMA da CPU (0 quando o sistema não informa)
+// ==============================================================================
+int NoDaCPU(int cpu)
+{
+	int no = 0;
+#ifdef __linux__
+	char caminho[64];
+	DIR *D;
+	struct dirent *e;
+	
+	if(cpu < 0)
+		return 0;
+	sprintf(caminho, "/sys/devices/system/cpu/cpu%d", cpu);
+	D = opendir(caminho);
+	if(D == NULL)
+		return 0;
+	while((e = readdir(D)) != NULL)
+		if(strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9')
+		{
+			no = atoi(e->d_name + 4);
+			break;
+		}
+	closedir(D);
+#endif
+	return no;
+}
+
+
+int NoAtual(void)
+{
+#ifdef __linux__
+	return NoDaCPU(sched_getcpu());
+#else
+	return 0;
+#endif
+}
+
+
+// ==============================================================================
+// Função PosicionaProcesso:  Fixa o processo k em uma CPU (pin) ou nas CPUs do
+//                            seu nó, e com NUMA_LOCAL prefere a memória desse nó
+// ==============================================================================
+void PosicionaProcesso(topologia *Tp, int k, bool pin, int numa)
+{
+#ifdef __linux__
+	cpu_set_t conj;
+	unsigned long mascara;
+	int i, no;
+	
+	if(Tp->n_cpus == 0)
+		return;
+	no = Tp->no[k % Tp->n_cpus];
+	CPU_ZERO(&conj);
+	if(pin)
+		CPU_SET(Tp->cpus[k % Tp->n_cpus], &conj);
+	else
+		for(i = 0; i < Tp->n_cpus; i++)
+			if(Tp->no[i] == no)
+				CPU_SET(Tp->cpus[i], &conj);
+	if(sched_setaffinity(0, sizeof(conj), &conj) != 0)
+		perror("sched_setaffinity");
+	
+	if(numa == NUMA_LOCAL && no < (int) (8*sizeof(mascara)))
+	{
+		mascara = 1UL << no;
+		if(syscall(SYS_set_mempolicy, POLITICA_PREFERIDA, &mascara, 8*sizeof(mascara)) != 0)
+			perror("set_mempolicy");
+	}
+#else
+	printf("--pin e --numa não são suportados neste sistema\n");
+#endif
+}
+
+
+// ==============================================================================
+// Função IntercalaMemoria:  Distribui as próximas páginas do processo (e dos 
+//                           processos criados por ele) entre todos os nós
+// ==============================================================================
+void IntercalaMemoria(topologia *Tp)
+{
+#ifdef __linux__
+	unsigned long mascara;
+	
+	if(Tp->n_nos > (int) (8*sizeof(mascara)))
+		return;
+	mascara = (Tp->n_nos == (int) (8*sizeof(mascara))) ? ~0UL : (1UL << Tp->n_nos) - 1;
+	if(syscall(SYS_set_mempolicy, POLITICA_INTERCALADA, &mascara, 8*sizeof(mascara)) != 0)
+		perror("set_mempolicy");
+#else
+	printf("--numa não é suportado neste sistema\n");
+#endif
+}
+
+
+
+// Função TamanhoCacheLLC:  Tamanho em bytes do último nível de cache da CPU 0
+//                           (0 quando o sistema não informa)
+// ==============================================================================
+long TamanhoCacheLLC(void)
+{
+	long tam = 0;
+#ifdef __linux__
+	char caminho[128], unidade;
+	FILE *Arq;
+	int i, nivel, maior;
+	long t;
+	
+	maior = 0;
+	for(i = 0; i < 16; i++)
+	{
+		sprintf(caminho, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+		Arq = fopen(caminho, "r");
+		if(Arq == NULL)
+			break;
+		if(fscanf(Arq, "%d", &nivel) != 1)
+			nivel = 0;
+		fclose(Arq);
+		sprintf(caminho, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+		Arq = fopen(caminho, "r");
+		if(Arq == NULL)
+			continue;
+		unidade = ' ';
+		if(fscanf(Arq, "%ld%c", &t, &unidade) >= 1 && nivel >= maior)
+		{
+			if(unidade == 'K')
+				t <<= 10;
+			else if(unidade == 'M')
+				t <<= 20;
+			maior = nivel;
+			tam = t;
+		}
+		fclose(Arq);
+	}
+#endif
+	return tam;
+}
+
+
+// ==============================================================================
+// Função MedeBanda:  Mede a banda de leitura da memória do processo: escreve 
+//                    (primeiro toque, no nó dado pela política) um vetor com 
+//                    2x o último nível de cache e o lê em sequência 
+//                    com quatro acumuladores independentes; com barreira, os P
+//                    processos começam a leitura juntos
+// ==============================================================================
+void MedeBanda(topologia *Tp, estat_no *en, volatile int *barreira, int P)
+{
+	unsigned long *A;
+	unsigned long s0, s1, s2, s3;
+	volatile unsigned long soma;
+	long n, i;
+	double t;
+	
+	n = 2*Tp->cache_llc;
+	if(n < BANDA_MIN_BYTES)
+		n = BANDA_MIN_BYTES;
+	if(n > BANDA_MAX_BYTES)
+		n = BANDA_MAX_BYTES;
+	n = n / (4*sizeof(unsigned long)) * 4;
+	A = (unsigned long *) malloc(n*sizeof(unsigned long)); 
+	if(A == NULL)
+		return;
+	// Ao fim da escrita o início do vetor já saiu da cache
+	for(i = 0; i < n; i++)
+		A[i] = i;
+	
+	// Espera os demais processos (no máximo 10 s, caso algum tenha falhado)
+	if(barreira != NULL)
+	{
+		__sync_fetch_and_add(barreira, 1);
+		t = Relogio();
+		while(*barreira < P && Relogio() - t < 10)
+			usleep(50);
+	}
+	
+	s0 = s1 = s2 = s3 = 0;
+	en->inicio = Relogio();
+	for(i = 0; i < n; i += 4)
+	{
+		s0 += A[i];
+		s1 += A[i+1];
+		s2 += A[i+2];
+		s3 += A[i+3];
+	}
+	en->fim = Relogio();
+	soma = s0 + s1 + s2 + s3;
+	(void) soma;
+	
+	en->no = NoAtual();
+	en->processos = 1;
+	en->bytes = n*sizeof(unsigned long);
+	free(A);
+}
+
+
+// ==============================================================================
+// Função HashBytes:  Acrescenta n bytes ao hash FNV-1a h
+// ==============================================================================
+unsigned long long HashBytes(unsigned long long h, const void *dados, size_t n)
+{
+	const unsigned char *p = (const unsigned char *) dados;
+	size_t i;
+	
+	for(i = 0; i < n; i++)
+	{
+		h ^= p[i];
+		h *= HASH_PRIMO;
+	}
+	return h;
+}
+
+
+void CacheArquivo(char *caminho, char *dir, unsigned long long hash)
+{
+	sprintf(caminho, "%s/%016llx.mst", dir, hash);
+}
+
+
+// ==============================================================================
+// Função CacheBusca:  Procura a solução do grafo com este hash no diretório de 
+//                     cache; em caso de acerto marca o arquivo como usado agora
+//                     (a data de modificação é a ordem do LRU)
+// ==============================================================================
+bool CacheBusca(char *dir, unsigned long long hash, grafo_original GO, solucao *Sol)
+{
+	char caminho[4096];
+	struct stat st;
+	cabecalho_cache *C;
+	void *mapa;
+	int *ind;
+	int fd, i;
+	bool achou;
+	
+	if(strlen(dir) > sizeof(caminho) - 32)
+		return false;
+	CacheArquivo(caminho, dir, hash);
+	fd = open(caminho, O_RDONLY);
+	if(fd < 0)
+		return false;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(cabecalho_cache))
+	{
+		close(fd);
+		return false;
+	}
+	mapa = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapa == MAP_FAILED)
+		return false;
+	
+	// O hash pode colidir: confere também o tamanho do grafo e do arquivo
+	C = (cabecalho_cache *) mapa;
+	ind = (int *) ((char *) mapa + sizeof(cabecalho_cache));
+	achou = (memcmp(C->magica, "MSTS", 4) == 0) && (C->hash == hash) && (C->n == GO.n) && (C->m == GO.m) 
+		&& (C->tam >= 0) && (C->tam < (GO.n > 0 ? GO.n : 1)) 
+		&& (st.st_size == (off_t) (sizeof(cabecalho_cache) + C->tam*sizeof(int)));
+	// Índices fora de GO (arquivo corrompido ou colisão) descartam a entrada
+	for(i = 0; achou && i < C->tam; i++)
+		if(ind[i] < 0 || ind[i] >= GO.m)
+			achou = false;
+	if(achou)
+	{
+		Sol->tam = C->tam;
+		Sol->it = C->it;
+		Sol->custo = C->custo;
+		Sol->arestas = (int *) malloc((GO.n > 1 ? GO.n-1 : 1)*sizeof(int)); 
+		memcpy(Sol->arestas, ind, C->tam*sizeof(int));
+	}
+	munmap(mapa, st.st_size);
+	if(achou)
+		utimes(caminho, NULL);
+	return achou;
+}
+
+
+// ==============================================================================
+// Função CacheGuarda:  Grava a solução no cache (arquivo temporário renomeado, 
+//                      para que leitores nunca vejam um arquivo pela metade) e
+//                      remove as entradas menos usadas além do limite em bytes
+// ==============================================================================
+void CacheGuarda(char *dir, long long limite, unsigned long long hash, grafo_original GO, solucao Sol)
+{
+	char caminho[4096], temp[4096];
+	cabecalho_cache C;
+	FILE *Arq;
+	bool ok;
+	
+	if(strlen(dir) > sizeof(caminho) - 32)
+		return;
+	mkdir(dir, 0755);
+	
+	memset(&C, 0, sizeof(C));
+	memcpy(C.magica, "MSTS", 4);
+	C.n = GO.n;
+	C.m = GO.m;
+	C.tam = Sol.tam;
+	C.it = Sol.it;
+	C.hash = hash;
+	C.custo = Sol.custo;
+	
+	CacheArquivo(caminho, dir, hash);
+	sprintf(temp, "%s/.%016llx.%d", dir, hash, (int) getpid());
+	Arq = fopen(temp, "wb");
+	if(Arq == NULL)
+	{
+		perror(temp);
+		return;
+	}
+	ok = (fwrite(&C, sizeof(C), 1, Arq) == 1) && (fwrite(Sol.arestas, sizeof(int), Sol.tam, Arq) == (size_t) Sol.tam);
+	ok = (fclose(Arq) == 0) && ok;
+	if(!ok || rename(temp, caminho) != 0)
+	{
+		perror(caminho);
+		unlink(temp);
+		return;
+	}
+	
+	CacheLimpa(dir, limite);
+}
+
+
+// Função CacheLimpa:  Remove as entradas usadas há mais tempo até que o total 
+//                     dos arquivos .mst caiba no limite: lê o diretório uma vez
+//                     e ordena as entradas pela data de modificação
+// ==============================================================================
+void CacheLimpa(char *dir, long long limite)
+{
+	char caminho[4096];
+	struct stat st;
+	struct dirent *e;
+	DIR *D;
+	entrada_cache *E;
+	long long total;
+	size_t n;
+	int num, cap, i;
+	
+	D = opendir(dir);
+	if(D == NULL)
+		return;
+	total = 0;
+	num = 0;
+	cap = 64;
+	E = (entrada_cache *) malloc(cap*sizeof(entrada_cache)); 
+	while((e = readdir(D)) != NULL)
+	{
+		n = strlen(e->d_name);
+		if(n < 4 || strcmp(e->d_name + n - 4, ".mst") != 0 || e->d_name[0] == '.')
+			continue;
+		if(strlen(dir) + n + 2 > sizeof(caminho))
+			continue;
+		strcpy(caminho, dir);
+		strcat(caminho, "/");
+		strcat(caminho, e->d_name);
+		if(stat(caminho, &st) != 0)
+			continue;
+		if(num == cap)
+		{
+			cap *= 2;
+			E = (entrada_cache *) realloc(E, cap*sizeof(entrada_cache)); 
+		}
+		E[num].caminho = strdup(caminho);
+		E[num].tam = st.st_size;
+		E[num].uso = st.st_mtim;
+		total += st.st_size;
+		num++;
+	}
+	closedir(D);
+	
+	qsort(E, num, sizeof(entrada_cache), ComparaEntradaCache);
+	for(i = 0; i < num && total > limite; i++)
+		if(unlink(E[i].caminho) == 0)
+			total -= E[i].tam;
+	
+	for(i = 0; i < num; i++)
+		free(E[i].caminho);
+	free(E);
+}
+
+
+int ComparaEntradaCache(const void *a, const void *b)
+{
+	const entrada_cache *x = (const entrada_cache *) a;
+	const entrada_cache *y = (const entrada_cache *) b;
+	
+	if(x->uso.tv_sec != y->uso.tv_sec)
+		return (x->uso.tv_sec > y->uso.tv_sec) - (x->uso.tv_sec < y->uso.tv_sec);
+	return (x->uso.tv_nsec > y->uso.tv_nsec) - (x->uso.tv_nsec < y->uso.tv_nsec);
+}